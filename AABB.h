@@ -0,0 +1,44 @@
+/*Axis aligned bounding box*/
+
+#ifndef AABB_H
+#define AABB_H
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box, empty until the first point is added
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void add(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const AABB& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    // Returns the box around this box after transforming it by matrix
+    AABB transformed(const glm::mat4& matrix) const {
+        // Arvo's method: the new extent along each axis is the sum of the absolute rotated extents
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(this->center(), 1.0f));
+        glm::vec3 extent = this->extent();
+        glm::vec3 newExtent(0.0f);
+        for (int axis = 0; axis < 3; axis++) {
+            newExtent += glm::abs(glm::vec3(matrix[axis])) * extent[axis];
+        }
+        AABB box;
+        box.min = center - newExtent;
+        box.max = center + newExtent;
+        return box;
+    }
+};
+
+#endif
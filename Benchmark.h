@@ -0,0 +1,235 @@
+/*Headless benchmark classes*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <GL/glew.h>
+
+// Keep Xlib out of the EGL headers
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// An OpenGL context with no window that renders into its own framebuffer object
+class HeadlessContext {
+public:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    GLuint FBO = 0, colorRBO = 0, depthRBO = 0;
+
+    // Creates a 3.3 core context, surfaceless when the driver allows it and on a small pbuffer otherwise
+    bool create() {
+        // Prefer the surfaceless platform so no display server is needed
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+        if (display == EGL_NO_DISPLAY) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+            std::cerr << "ERROR::HEADLESS::NO_EGL_DISPLAY" << std::endl;
+            return false;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+            std::cerr << "ERROR::HEADLESS::NO_EGL_CONFIG" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT) {
+            std::cerr << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED" << std::endl;
+            return false;
+        }
+
+        // Fall back to a pbuffer when surfaceless contexts are not supported
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+            if (!eglMakeCurrent(display, surface, surface, context)) {
+                std::cerr << "ERROR::HEADLESS::MAKE_CURRENT_FAILED" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Creates the framebuffer object the scene is rendered into and binds it
+    void createFramebuffer(GLsizei width, GLsizei height) {
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    void destroy() {
+        if (FBO != 0) {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteRenderbuffers(1, &colorRBO);
+            glDeleteRenderbuffers(1, &depthRBO);
+        }
+        if (display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (surface != EGL_NO_SURFACE)
+                eglDestroySurface(display, surface);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+    }
+};
+
+// Measures CPU and GPU time per frame and summarizes them as JSON
+class FrameTimer {
+public:
+    // Frames at the start that are not recorded while caches and the driver warm up
+    int warmupFrames = 5;
+    // GPU time of the latest frame whose query has been read and that frame's number, -1 until the first one
+    double lastGpuMs = 0.0;
+    long lastGpuFrame = -1;
+
+    FrameTimer() {
+        glGenQueries(RING_SIZE, queries);
+    }
+
+    void beginFrame() {
+        int slot = frameIndex % RING_SIZE;
+        // The query in this slot was issued RING_SIZE frames ago, so reading it rarely waits
+        collect(slot);
+        cpuStart = std::chrono::steady_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    }
+
+    void endFrame() {
+        int slot = frameIndex % RING_SIZE;
+        glEndQuery(GL_TIME_ELAPSED);
+        pendingFrame[slot] = frameIndex;
+        double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+        if (frameIndex >= warmupFrames) {
+            cpuTimes.push_back(cpuMs);
+        }
+        frameIndex++;
+    }
+
+    // Reads every outstanding query, call after the last frame
+    void finish() {
+        for (int slot = 0; slot < RING_SIZE; slot++) {
+            collect(slot);
+        }
+    }
+
+    // Returns min/median/p95/p99/max of the recorded CPU and GPU frame times in milliseconds
+    std::string toJson(const std::string& renderer, GLsizei width, GLsizei height) const {
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"renderer\": \"" << escape(renderer) << "\",\n"
+             << "  \"width\": " << width << ",\n"
+             << "  \"height\": " << height << ",\n"
+             << "  \"frames\": " << cpuTimes.size() << ",\n"
+             << "  \"warmup_frames\": " << warmupFrames << ",\n"
+             << "  \"cpu_ms\": " << summary(cpuTimes) << ",\n"
+             << "  \"gpu_ms\": " << summary(gpuTimes) << "\n"
+             << "}\n";
+        return json.str();
+    }
+
+    void destroy() {
+        glDeleteQueries(RING_SIZE, queries);
+    }
+
+private:
+    static const int RING_SIZE = 4;
+    GLuint queries[RING_SIZE];
+    long pendingFrame[RING_SIZE] = { -1, -1, -1, -1 };
+    long frameIndex = 0;
+    std::chrono::steady_clock::time_point cpuStart;
+    std::vector<double> cpuTimes, gpuTimes;
+
+    void collect(int slot) {
+        if (pendingFrame[slot] < 0) {
+            return;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        lastGpuMs = elapsed / 1.0e6;
+        lastGpuFrame = pendingFrame[slot];
+        if (pendingFrame[slot] >= warmupFrames) {
+            gpuTimes.push_back(elapsed / 1.0e6);
+        }
+        pendingFrame[slot] = -1;
+    }
+
+    // Nearest-rank percentile of sorted samples
+    static double percentile(const std::vector<double>& sorted, double p) {
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+
+    static std::string summary(std::vector<double> samples) {
+        std::ostringstream json;
+        if (samples.empty()) {
+            json << "null";
+            return json.str();
+        }
+        std::sort(samples.begin(), samples.end());
+        json << "{ \"min\": " << samples.front()
+             << ", \"median\": " << percentile(samples, 50.0)
+             << ", \"p95\": " << percentile(samples, 95.0)
+             << ", \"p99\": " << percentile(samples, 99.0)
+             << ", \"max\": " << samples.back() << " }";
+        return json.str();
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+/*Bounding volume hierarchy class*/
+
+#ifndef BOUNDING_VOLUME_HIERARCHY_H
+#define BOUNDING_VOLUME_HIERARCHY_H
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BVH_USE_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// Result of testing a box against the frustum
+enum FrustumTest { FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTS, FRUSTUM_INSIDE };
+
+// The six planes of a view frustum, stored plane-major in two groups of four so one SSE
+// operation tests a box against four planes at once
+class Frustum {
+public:
+    // Extracts the planes of projection * view (Gribb and Hartmann)
+    explicit Frustum(const glm::mat4& viewProjection) {
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; row++) {
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        }
+        glm::vec4 planes[8] = {
+            rows[3] + rows[0], rows[3] - rows[0],   // Left, right
+            rows[3] + rows[1], rows[3] - rows[1],   // Bottom, top
+            rows[3] + rows[2], rows[3] - rows[2],   // Near, far
+            rows[3] + rows[2], rows[3] - rows[2]    // Repeated to fill the second group
+        };
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 plane = planes[i] / glm::length(glm::vec3(planes[i]));
+            nx[i] = plane.x;
+            ny[i] = plane.y;
+            nz[i] = plane.z;
+            d[i] = plane.w;
+            ax[i] = std::fabs(plane.x);
+            ay[i] = std::fabs(plane.y);
+            az[i] = std::fabs(plane.z);
+        }
+    }
+
+    FrustumTest test(const AABB& box) const {
+        glm::vec3 c = box.center(), e = box.extent();
+#ifdef BVH_USE_SSE
+        __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+        int outside = 0, inside = 0xFF;
+        for (int group = 0; group < 8; group += 4) {
+            // Signed distance of the center and the box's projected radius for four planes
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(nx + group), cx), _mm_mul_ps(_mm_load_ps(ny + group), cy)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_load_ps(nz + group), cz), _mm_load_ps(d + group)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(ax + group), ex), _mm_mul_ps(_mm_load_ps(ay + group), ey)),
+                                       _mm_mul_ps(_mm_load_ps(az + group), ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            inside &= _mm_movemask_ps(_mm_cmpge_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps())) | 0xF0;
+        }
+        if (outside) {
+            return FRUSTUM_OUTSIDE;
+        }
+        return (inside & 0xF) == 0xF ? FRUSTUM_INSIDE : FRUSTUM_INTERSECTS;
+#else
+        bool inside = true;
+        for (int i = 0; i < 6; i++) {
+            float distance = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+            float radius = ax[i] * e.x + ay[i] * e.y + az[i] * e.z;
+            if (distance + radius < 0.0f) {
+                return FRUSTUM_OUTSIDE;
+            }
+            inside = inside && distance - radius >= 0.0f;
+        }
+        return inside ? FRUSTUM_INSIDE : FRUSTUM_INTERSECTS;
+#endif
+    }
+
+private:
+    alignas(16) float nx[8], ny[8], nz[8], d[8];
+    // Absolute normals for the projected radius
+    alignas(16) float ax[8], ay[8], az[8];
+};
+
+// Binary tree of bounding boxes over the scene's objects, culled against a frustum each frame
+class BoundingVolumeHierarchy {
+public:
+    // Box tests and culled objects of the last cull
+    long tested = 0, culled = 0;
+
+    // Builds the tree over the objects' world space boxes, call again after objects move
+    void build(const std::vector<AABB>& boxes) {
+        nodes.clear();
+        items.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            items[i] = (uint32_t)i;
+        }
+        this->boxes = boxes;
+        if (!boxes.empty()) {
+            nodes.reserve(boxes.size() * 2);
+            nodes.push_back(Node());
+            split(0, 0, (uint32_t)boxes.size());
+        }
+    }
+
+    // Sets visible[i] to whether object i may be seen through the frustum
+    void cull(const Frustum& frustum, std::vector<char>& visible) {
+        visible.assign(boxes.size(), 0);
+        tested = 0;
+        if (!nodes.empty()) {
+            visit(0, frustum, visible);
+        }
+        culled = (long)boxes.size();
+        for (char seen : visible) {
+            culled -= seen;
+        }
+        frames++;
+        totalTested += tested;
+        totalCulled += culled;
+    }
+
+    // Prints the average number of box tests and culled objects per frame
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Culling: " << boxes.size() << " objects in " << nodes.size() << " nodes, "
+                      << (double)totalTested / frames << " box tests and " << (double)totalCulled / frames
+                      << " objects culled per frame" << std::endl;
+        }
+    }
+
+private:
+    // Interior nodes keep their children next to each other: left is first, right is first + 1.
+    // Leaves hold count objects starting at first in items.
+    struct Node {
+        AABB box;
+        uint32_t first;
+        uint32_t count;     // 0 for interior nodes
+    };
+
+    static const uint32_t LEAF_SIZE = 2;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> items;
+    std::vector<AABB> boxes;
+    long frames = 0, totalTested = 0, totalCulled = 0;
+
+    // Fills the node at index with items [begin, end), splitting them at the median of the longest axis
+    void split(uint32_t index, uint32_t begin, uint32_t end) {
+        AABB box, centers;
+        for (uint32_t i = begin; i < end; i++) {
+            box.add(boxes[items[i]]);
+            centers.add(boxes[items[i]].center());
+        }
+        nodes[index].box = box;
+        if (end - begin <= LEAF_SIZE) {
+            nodes[index].first = begin;
+            nodes[index].count = end - begin;
+            return;
+        }
+
+        glm::vec3 size = centers.max - centers.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        uint32_t middle = (begin + end) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [&](uint32_t a, uint32_t b) {
+            return boxes[a].center()[axis] < boxes[b].center()[axis];
+        });
+
+        // Both children are allocated together so they sit next to each other
+        uint32_t left = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        split(left, begin, middle);
+        split(left + 1, middle, end);
+    }
+
+    void visit(uint32_t index, const Frustum& frustum, std::vector<char>& visible) {
+        const Node& node = nodes[index];
+        tested++;
+        FrustumTest result = frustum.test(node.box);
+        if (result == FRUSTUM_OUTSIDE) {
+            return;
+        }
+        if (result == FRUSTUM_INSIDE) {
+            // Everything below is visible, no need to test it
+            markVisible(index, visible);
+            return;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                tested++;
+                if (frustum.test(boxes[items[i]]) != FRUSTUM_OUTSIDE) {
+                    visible[items[i]] = 1;
+                }
+            }
+            return;
+        }
+        visit(node.first, frustum, visible);
+        visit(node.first + 1, frustum, visible);
+    }
+
+    void markVisible(uint32_t index, std::vector<char>& visible) const {
+        const Node& node = nodes[index];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                visible[items[i]] = 1;
+            }
+            return;
+        }
+        markVisible(node.first, visible);
+        markVisible(node.first + 1, visible);
+    }
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*Clustered lights class*/
+
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+
+// A small point light that fades out to nothing at its radius
+struct PointLight {
+    glm::vec3 position;     // World space
+    float radius;
+    glm::vec3 color;
+    float intensity;
+};
+
+// Clustered forward lighting. The view frustum is split into CLUSTERS_X x CLUSTERS_Y screen tiles and
+// CLUSTERS_Z depth slices that grow exponentially with distance. Every frame the lights are assigned on
+// the CPU to the clusters their spheres touch, one job per depth slice, and the result goes to the
+// fragment shader in three texture buffers: the lights, an offset and count per cluster and the light
+// indices of all clusters back to back. A fragment only loops over the lights of its own cluster, so the
+// shading cost depends on how many lights overlap a spot rather than on how many lights there are.
+class ClusteredLights {
+public:
+    // Must match CLUSTER_COUNTS in Project5.frag
+    static const int CLUSTERS_X = 16, CLUSTERS_Y = 12, CLUSTERS_Z = 24;
+    // Texture units of the lightData, clusterGrid and lightIndices samplers
+    static const GLint LIGHT_UNIT = 2, GRID_UNIT = 3, INDEX_UNIT = 4;
+
+    std::vector<PointLight> lights;
+
+    // Sets up the clusters for a perspective projection drawn to a width x height viewport
+    void setProjection(float fovy, float aspect, float zNear, float zFar, int width, int height) {
+        near = zNear;
+        far = zFar;
+        tileWidth = (float)width / CLUSTERS_X;
+        tileHeight = (float)height / CLUSTERS_Y;
+        float logRatio = std::log(zFar / zNear);
+        depthScale = CLUSTERS_Z / logRatio;
+        depthBias = -CLUSTERS_Z * std::log(zNear) / logRatio;
+
+        // View space bounds of every cluster, from the corners of its tile at the near and far depth of its slice
+        float tanY = std::tan(fovy * 0.5f), tanX = tanY * aspect;
+        bounds.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+        for (int z = 0; z < CLUSTERS_Z; z++) {
+            float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+            for (int y = 0; y < CLUSTERS_Y; y++) {
+                for (int x = 0; x < CLUSTERS_X; x++) {
+                    Bounds& box = bounds[index(x, y, z)];
+                    box.min = glm::vec3(FLT_MAX);
+                    box.max = glm::vec3(-FLT_MAX);
+                    for (float depth : depths) {
+                        for (int corner = 0; corner < 4; corner++) {
+                            float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTERS_X;
+                            float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTERS_Y;
+                            glm::vec3 point(ndcX * tanX * depth, ndcY * tanY * depth, -depth);
+                            box.min = glm::min(box.min, point);
+                            box.max = glm::max(box.max, point);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Tile size in pixels and the scale and bias that turn log(view depth) into a depth slice, for clusterParams
+    glm::vec4 params() const {
+        return glm::vec4(tileWidth, tileHeight, depthScale, depthBias);
+    }
+
+    // Assigns the lights to the clusters seen through view and uploads the result to the texture buffers
+    void update(const glm::mat4& view, JobSystem& jobs) {
+        if (buffers[0] == 0) {
+            create();
+        }
+
+        // Light spheres in view space
+        std::vector<glm::vec4> spheres(lights.size());
+        for (size_t i = 0; i < lights.size(); i++) {
+            spheres[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+        }
+
+        // Every slice collects its own light indices, with offsets counted from the start of the slice
+        grid.assign(bounds.size() * 2, 0);
+        slices.resize(CLUSTERS_Z);
+        JobGroup assign;
+        jobs.parallelFor(assign, CLUSTERS_Z, 1, [&](size_t begin, size_t end) {
+            for (size_t z = begin; z < end; z++) {
+                assignSlice((int)z, spheres, slices[z]);
+            }
+        });
+        jobs.wait(assign);
+
+        // Join the slices into one index list
+        indices.clear();
+        for (int z = 0; z < CLUSTERS_Z; z++) {
+            uint32_t base = (uint32_t)indices.size();
+            for (int cluster = index(0, 0, z); cluster < index(0, 0, z + 1); cluster++) {
+                grid[cluster * 2] += base;
+                maxPerCluster = std::max(maxPerCluster, (long)grid[cluster * 2 + 1]);
+            }
+            indices.insert(indices.end(), slices[z].begin(), slices[z].end());
+        }
+
+        // Two texels per light: position and radius, then color and intensity. Never empty so the buffer stays valid.
+        std::vector<glm::vec4> texels(std::max<size_t>(1, lights.size()) * 2, glm::vec4(0.0f));
+        for (size_t i = 0; i < lights.size(); i++) {
+            texels[i * 2] = glm::vec4(lights[i].position, lights[i].radius);
+            texels[i * 2 + 1] = glm::vec4(lights[i].color, lights[i].intensity);
+        }
+        if (indices.empty()) {
+            indices.push_back(0);
+        }
+        upload(0, texels.data(), texels.size() * sizeof(glm::vec4));
+        upload(1, grid.data(), grid.size() * sizeof(uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(uint32_t));
+
+        frames++;
+        totalIndices += (long)indices.size();
+    }
+
+    // Prints how many lights a cluster held on average and at most
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Clustered lights: " << lights.size() << " lights in " << CLUSTERS_X << " x " << CLUSTERS_Y << " x "
+                      << CLUSTERS_Z << " clusters, " << (double)totalIndices / frames / bounds.size()
+                      << " lights per cluster on average, " << maxPerCluster << " at most" << std::endl;
+        }
+    }
+
+    void destroy() {
+        if (buffers[0] != 0) {
+            glDeleteTextures(3, textures);
+            glDeleteBuffers(3, buffers);
+            buffers[0] = buffers[1] = buffers[2] = 0;
+        }
+    }
+
+private:
+    struct Bounds {
+        glm::vec3 min, max;
+    };
+
+    float near = 0.1f, far = 100.0f;
+    float tileWidth = 1.0f, tileHeight = 1.0f, depthScale = 1.0f, depthBias = 0.0f;
+    std::vector<Bounds> bounds;
+    // Offset and count of every cluster, then the light indices of all clusters
+    std::vector<uint32_t> grid, indices;
+    std::vector<std::vector<uint32_t>> slices;
+    // Texture buffers and their textures: lights, grid, indices
+    GLuint buffers[3] = { 0, 0, 0 };
+    GLuint textures[3] = { 0, 0, 0 };
+    long frames = 0, totalIndices = 0, maxPerCluster = 0;
+
+    static int index(int x, int y, int z) {
+        return (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+    }
+
+    // View depth where slice z starts
+    float sliceDepth(int z) const {
+        return near * std::pow(far / near, (float)z / CLUSTERS_Z);
+    }
+
+    // Finds the lights touching each cluster of slice z
+    void assignSlice(int z, const std::vector<glm::vec4>& spheres, std::vector<uint32_t>& sliceIndices) {
+        sliceIndices.clear();
+        float nearDepth = sliceDepth(z), farDepth = sliceDepth(z + 1);
+        // Only lights that reach into the slice are tested against its clusters
+        std::vector<uint32_t> candidates;
+        for (size_t i = 0; i < spheres.size(); i++) {
+            float depth = -spheres[i].z;
+            if (depth + spheres[i].w >= nearDepth && depth - spheres[i].w <= farDepth) {
+                candidates.push_back((uint32_t)i);
+            }
+        }
+        for (int cluster = index(0, 0, z); cluster < index(0, 0, z + 1); cluster++) {
+            const Bounds& box = bounds[cluster];
+            grid[cluster * 2] = (uint32_t)sliceIndices.size();
+            for (uint32_t light : candidates) {
+                // Distance from the sphere's center to the nearest point of the box
+                glm::vec3 center(spheres[light]);
+                glm::vec3 offset = glm::max(box.min - center, glm::max(glm::vec3(0.0f), center - box.max));
+                if (glm::dot(offset, offset) <= spheres[light].w * spheres[light].w) {
+                    sliceIndices.push_back(light);
+                }
+            }
+            grid[cluster * 2 + 1] = (uint32_t)sliceIndices.size() - grid[cluster * 2];
+        }
+    }
+
+    void create() {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        GLint units[3] = { LIGHT_UNIT, GRID_UNIT, INDEX_UNIT };
+        for (int i = 0; i < 3; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Replaces the contents of a texture buffer, orphaning the storage the GPU may still be reading
+    void upload(int buffer, const void* data, size_t size) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*Draw ring class*/
+
+#ifndef DRAW_RING_H
+#define DRAW_RING_H
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Per-draw data in the std140 layout of the DrawRecord struct in Project5.vs and Project5.frag
+struct DrawRecord {
+    float model[16];
+    float normalMatrix[12];     // mat3, each column padded to a vec4
+    float color[4];             // rgb and alpha
+    int32_t flags[4];           // instanced, useTexture, brighter, mirror
+    float uvRect[4];            // Offset and scale of the texture coordinates, the image's region of an atlas
+
+    DrawRecord(const glm::mat4& model, const glm::mat3& normal, const glm::vec4& color,
+               bool instanced, bool useTexture, bool brighter, bool mirror, const glm::vec4& uvRect) {
+        std::memcpy(this->model, glm::value_ptr(model), sizeof(this->model));
+        for (int column = 0; column < 3; column++) {
+            normalMatrix[column * 4 + 0] = normal[column][0];
+            normalMatrix[column * 4 + 1] = normal[column][1];
+            normalMatrix[column * 4 + 2] = normal[column][2];
+            normalMatrix[column * 4 + 3] = 0.0f;
+        }
+        std::memcpy(this->color, glm::value_ptr(color), sizeof(this->color));
+        flags[0] = instanced;
+        flags[1] = useTexture;
+        flags[2] = brighter;
+        flags[3] = mirror;
+        std::memcpy(this->uvRect, glm::value_ptr(uvRect), sizeof(this->uvRect));
+    }
+};
+
+// A uniform buffer split into one region per frame in flight. The CPU writes a frame's DrawRecords into
+// the next region back to back. The DrawData block sees a window of RECORDS_PER_WINDOW of them at a
+// time and every draw picks its record by index, so no per-object uniforms are set and the window is
+// only rebound every hundred or so draws. A fence per region keeps the CPU from overwriting records the
+// GPU has not read yet. The buffer is mapped once for good with glBufferStorage where available and
+// updated with one glBufferSubData per frame otherwise.
+class DrawRing {
+public:
+    static const int FRAMES = 3;
+    // Uniform buffer binding point of the DrawData block
+    static const GLuint BINDING = 0;
+    // Length of the draws array in the DrawData block, 102 records fit the 16 KB every GL 3.3 driver allows
+    static const size_t RECORDS_PER_WINDOW = 102;
+
+    // Starts a frame that will write up to records DrawRecords, waiting if the GPU still reads its region
+    void beginFrame(size_t records) {
+        if (records > capacity) {
+            create(records * 2);
+        }
+        region = (region + 1) % FRAMES;
+        if (fences[region]) {
+            // Three frames old, so this normally returns at once
+            GLenum status = glClientWaitSync(fences[region], 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                waits++;
+                while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+                }
+            }
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+        used = 0;
+        boundWindow = SIZE_MAX;
+    }
+
+    // Copies a record into this frame's region and returns its index in the frame
+    uint32_t push(const DrawRecord& record) {
+        std::memcpy(writeBase() + used * sizeof(DrawRecord), &record, sizeof(record));
+        return (uint32_t)used++;
+    }
+
+    // Makes the records written so far visible to the GPU, call before the frame's draws
+    void upload() {
+        if (!persistent && used > 0) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, region * regionBytes, used * sizeof(DrawRecord), staging.data());
+        }
+    }
+
+    // First record of the window that holds record, windows start where the buffer offset alignment allows.
+    // Records [window, window + RECORDS_PER_WINDOW) can be drawn without rebinding.
+    size_t windowOf(uint32_t record) const {
+        return record / granule * granule;
+    }
+
+    // Points the DrawData block at the window starting at record window, unless it already is
+    void bindWindow(size_t window) {
+        if (window != boundWindow) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, buffer, region * regionBytes + window * sizeof(DrawRecord),
+                              RECORDS_PER_WINDOW * sizeof(DrawRecord));
+            boundWindow = window;
+            windowBinds++;
+        }
+    }
+
+    // Fences the frame's draws, call after the last draw that reads this frame's records
+    void endFrame() {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frames++;
+        totalRecords += used;
+        totalWindowBinds += windowBinds;
+        windowBinds = 0;
+    }
+
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Draw ring: " << (persistent ? "persistently mapped" : "updated once per frame") << ", "
+                      << FRAMES << " x " << capacity << " records, " << (double)totalRecords / frames << " records and "
+                      << (double)totalWindowBinds / frames << " window binds per frame, " << waits << " waits on the GPU" << std::endl;
+        }
+    }
+
+    void destroy() {
+        for (auto& fence : fences) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+        if (buffer != 0) {
+            if (persistent) {
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+        mapped = nullptr;
+        capacity = 0;
+    }
+
+private:
+    GLuint buffer = 0;
+    bool persistent = false;
+    unsigned char* mapped = nullptr;            // Whole buffer when persistently mapped
+    std::vector<unsigned char> staging;         // One region when updated with glBufferSubData
+    size_t capacity = 0;                        // Records per region
+    size_t regionBytes = 0;                     // Room for capacity records and a full window after the last one
+    size_t granule = 1;                         // Records between window starts that meet the offset alignment
+    size_t used = 0;
+    size_t boundWindow = SIZE_MAX;
+    int region = 0;
+    GLsync fences[FRAMES] = {};
+    long windowBinds = 0;
+    long frames = 0, totalRecords = 0, totalWindowBinds = 0, waits = 0;
+
+    unsigned char* writeBase() {
+        return persistent ? mapped + region * regionBytes : staging.data();
+    }
+
+    // (Re)creates the buffer with room for records per region, waiting for the GPU to finish with the old one
+    void create(size_t records) {
+        for (auto& fence : fences) {
+            if (fence) {
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            }
+        }
+        destroy();
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        // Smallest number of records whose size is a multiple of the alignment
+        granule = 1;
+        while ((granule * sizeof(DrawRecord)) % alignment != 0) {
+            granule++;
+        }
+        capacity = records;
+        regionBytes = ((capacity + RECORDS_PER_WINDOW) * sizeof(DrawRecord) + alignment - 1) / alignment * alignment;
+        GLsizeiptr size = (GLsizeiptr)(FRAMES * regionBytes);
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+            persistent = mapped != nullptr;
+        }
+        if (!persistent) {
+            // A buffer made with glBufferStorage cannot be respecified, start again with a plain one
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+            staging.assign(regionBytes, 0);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+
+#endif
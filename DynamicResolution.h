@@ -0,0 +1,150 @@
+/*Dynamic resolution class*/
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <GL/glew.h>
+
+// Draws the frame into an offscreen target at a fraction of the window's resolution and stretches it over
+// the window, picking the fraction so the GPU time per frame stays within budget. A PI controller steers the
+// rendered area from the measured GPU time. The fraction only changes once the controller has moved it by at
+// least STEP, and measurements of frames drawn before a change are ignored, so it settles instead of hunting.
+class DynamicResolution {
+public:
+    // Smallest change of the resolution fraction that is applied
+    static constexpr float STEP = 0.05f;
+    // Errors smaller than this fraction of the budget do not wind up the controller
+    static constexpr float DEADBAND = 0.1f;
+    // Proportional and integral gains, per frame
+    static constexpr float KP = 0.5f, KI = 0.1f;
+
+    float budget = 0.0f;        // Milliseconds of GPU time per frame, 0 draws straight to the window
+    float minScale = 0.5f;      // Lowest fraction of the window's width and height the frame is drawn at
+    float scale = 1.0f;         // Fraction the current frame is drawn at
+
+    bool enabled() const {
+        return framebuffer != 0;
+    }
+
+    // Makes the offscreen target for a window of width x height pixels, if a budget was set
+    void create(int width, int height) {
+        if (budget <= 0.0f) {
+            return;
+        }
+        this->width = width;
+        this->height = height;
+        area = scale * scale;
+
+        // The target always has the window's size and frames only use its lower left corner, so changing
+        // the resolution never reallocates anything
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Feeds the GPU time of an earlier frame, numbered from 0 like the frames begin() starts, to the controller
+    void update(double gpuMs, long sampleFrame) {
+        if (!enabled() || sampleFrame <= lastSample || sampleFrame < changedFrame) {
+            return;
+        }
+        lastSample = sampleFrame;
+
+        // Positive when there is time left over. The rendered area is steered rather than the fraction since
+        // the GPU time of a frame grows with its pixel count.
+        float error = (float)((budget - gpuMs) / budget);
+        if (std::fabs(error) < DEADBAND) {
+            error = 0.0f;
+        }
+        float change = KP * (error - previousError) + KI * error;
+        previousError = error;
+        area = std::min(1.0f, std::max(minScale * minScale, area * (1.0f + change)));
+
+        // Small moves are held back, except the last bit up to either limit
+        float wanted = std::sqrt(area);
+        bool atLimit = area >= 1.0f || area <= minScale * minScale;
+        if (std::fabs(wanted - scale) >= STEP || (atLimit && wanted != scale)) {
+            scale = wanted;
+            changes++;
+            // Frames already in flight were drawn at the old fraction
+            changedFrame = frames;
+        }
+    }
+
+    // Pixel size the current frame is drawn at
+    int scaledWidth() const {
+        return std::max(1, (int)std::lround(width * scale));
+    }
+    int scaledHeight() const {
+        return std::max(1, (int)std::lround(height * scale));
+    }
+
+    // Starts drawing a frame into the offscreen target
+    void begin() {
+        if (!enabled()) {
+            return;
+        }
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, scaledWidth(), scaledHeight());
+        frames++;
+        totalScale += scale;
+    }
+
+    // Stretches the frame over the framebuffer that was bound before begin(), filtered bilinearly
+    void end() {
+        if (!enabled()) {
+            return;
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, savedFramebuffer);
+        glBlitFramebuffer(0, 0, scaledWidth(), scaledHeight(), 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                          scale < 1.0f ? GL_LINEAR : GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    // Prints the average resolution and how often it changed
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Dynamic resolution: " << budget << " ms budget, drawn at " << 100.0 * totalScale / frames
+                      << "% of the window's width and height on average, " << changes << " changes in " << frames
+                      << " frames, ended at " << scaledWidth() << " x " << scaledHeight() << std::endl;
+        }
+    }
+
+    void destroy() {
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(2, renderbuffers);
+            framebuffer = 0;
+        }
+    }
+
+private:
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = { 0, 0 };     // Color and depth
+    int width = 0, height = 0;
+    GLint savedFramebuffer = 0;
+    // Controller state: the wanted share of the window's pixels and the last error
+    float area = 1.0f, previousError = 0.0f;
+    long frames = 0, lastSample = -1, changedFrame = 0, changes = 0;
+    double totalScale = 0.0;
+};
+
+#endif
@@ -0,0 +1,262 @@
+/*Geometry registry class*/
+
+#ifndef GEOMETRY_REGISTRY_H
+#define GEOMETRY_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include "AABB.h"
+#include "DrawRing.h"
+
+// Handle used by objects to refer to a shared primitive shape
+typedef int GeometryHandle;
+const GeometryHandle INVALID_GEOMETRY = -1;
+
+// A shape stored once in the registry's shared vertex and index buffers
+struct Geometry {
+    std::string name;
+    GLsizei indexCount;
+    GLuint firstIndex;      // Where the shape's indices start in the shared index buffer
+    GLint baseVertex;       // Where the shape's vertices start in the shared vertex buffer
+    GLsizei vertexCount;
+    GLsizeiptr bytes;       // Vertex and index bytes the shape adds to the shared buffers
+    // Bounds of the vertices in model space
+    AABB bounds;
+    // Number of objects that refer to this shape
+    int users;
+};
+
+// Packs every shape into one vertex buffer and one index buffer drawn through a single VAO,
+// and hands out handles to the objects that use them
+class GeometryRegistry {
+public:
+    // Vertex attribute that tells the shaders which DrawRecord a draw uses
+    static const GLuint DRAW_INDEX_ATTRIBUTE = 12;
+
+    // The shared VAO, vertex buffer and index buffer, created by the first acquire()
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    // Whether draws through the shared VAO can be combined with glMultiDrawElementsIndirect
+    bool multiDraw = false;
+
+    // Returns the handle of the named shape, adding its vertices the first time it is requested.
+    // vertices is a triangle list in the interleaved position/normal/texcoord layout of 8 floats.
+    GeometryHandle acquire(const std::string& name, const GLfloat* vertices, GLsizeiptr size) {
+        GeometryHandle found = find(name);
+        if (found != INVALID_GEOMETRY) {
+            return found;
+        }
+        // Weld the identical corners of the triangle list, the primitive shapes are small enough to search linearly
+        size_t count = (size_t)size / (8 * sizeof(GLfloat));
+        std::vector<GLfloat> welded;
+        std::vector<uint32_t> indices;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t index = (uint32_t)(welded.size() / 8);
+            for (uint32_t j = 0; j < welded.size() / 8; j++) {
+                if (std::memcmp(&welded[j * 8], vertices + i * 8, 8 * sizeof(GLfloat)) == 0) {
+                    index = j;
+                    break;
+                }
+            }
+            if (index == welded.size() / 8) {
+                welded.insert(welded.end(), vertices + i * 8, vertices + i * 8 + 8);
+            }
+            indices.push_back(index);
+        }
+        return add(name, welded.data(), welded.size() / 8, indices.data(), indices.size());
+    }
+
+    // Returns the handle of the named indexed mesh, adding it the first time it is requested
+    GeometryHandle acquireIndexed(const std::string& name, const GLfloat* vertices, size_t vertexCount,
+                                  const uint32_t* indices, size_t indexCount) {
+        GeometryHandle found = find(name);
+        if (found != INVALID_GEOMETRY) {
+            return found;
+        }
+        return add(name, vertices, vertexCount, indices, indexCount);
+    }
+
+    const Geometry& get(GeometryHandle handle) const {
+        return geometries[handle];
+    }
+
+    // The shape's vertices, 8 floats each, and its indices, which count from the shape's first vertex
+    const GLfloat* vertexData(GeometryHandle handle) const {
+        return &vertices[geometries[handle].baseVertex * 8];
+    }
+
+    const uint32_t* indexData(GeometryHandle handle) const {
+        return &indices[geometries[handle].firstIndex];
+    }
+
+    // Binds a VAO while keeping the bind count accurate
+    void bindVertexArray(GLuint VAO) {
+        // With one VAO per object every draw used to switch VAOs
+        requestedBinds++;
+        if (VAO != boundVAO) {
+            glBindVertexArray(VAO);
+            boundVAO = VAO;
+            actualBinds++;
+        }
+    }
+
+    // Starts counting the binds of a new frame and uploads shapes added since the last one
+    void beginFrame() {
+        totalRequestedBinds += requestedBinds;
+        totalActualBinds += actualBinds;
+        if (requestedBinds > 0) {
+            frames++;
+        }
+        requestedBinds = 0;
+        actualBinds = 0;
+        if (dirty) {
+            upload();
+        }
+        // State may have been changed outside the registry between frames
+        glBindVertexArray(0);
+        boundVAO = 0;
+    }
+
+    // Prints how much buffer memory and how many VAO binds per frame sharing saves over one VAO/VBO per object
+    void report() const {
+        GLsizeiptr uploaded = 0, unshared = 0;
+        int objects = 0;
+        for (const auto& geometry : geometries) {
+            uploaded += geometry.bytes;
+            unshared += geometry.bytes * geometry.users;
+            objects += geometry.users;
+        }
+        std::cout << "Geometry: " << geometries.size() << " shapes shared by " << objects << " objects in one "
+                  << vertices.size() / 8 << " vertex, " << indices.size() << " index buffer, "
+                  << uploaded << " bytes uploaded instead of " << unshared
+                  << " (" << (unshared - uploaded) << " bytes saved)" << std::endl;
+        if (frames > 0) {
+            std::cout << "Geometry: " << (double)totalActualBinds / frames << " VAO binds per frame instead of "
+                      << (double)totalRequestedBinds / frames << std::endl;
+        }
+    }
+
+    // Deletes the shared VAO and buffers
+    void destroy() {
+        if (VAO != 0) {
+            glDeleteVertexArrays(1, &VAO);
+            GLuint buffers[3] = { VBO, EBO, drawIndexVBO };
+            glDeleteBuffers(3, buffers);
+        }
+        VAO = VBO = EBO = drawIndexVBO = 0;
+        geometries.clear();
+        vertices.clear();
+        indices.clear();
+        boundVAO = 0;
+    }
+
+private:
+    std::vector<Geometry> geometries;
+    // CPU copies of the shared buffers, uploaded whole whenever a shape was added
+    std::vector<GLfloat> vertices;
+    std::vector<uint32_t> indices;
+    bool dirty = false;
+    // Holds 0, 1, 2, ... so an instanced attribute turns a multi-draw command's base instance into its draw index
+    GLuint drawIndexVBO = 0;
+    GLuint boundVAO = 0;
+    // Bind counters for the current frame and totals over all finished frames
+    long requestedBinds = 0, actualBinds = 0;
+    long totalRequestedBinds = 0, totalActualBinds = 0;
+    long frames = 0;
+
+    GeometryHandle find(const std::string& name) {
+        for (size_t i = 0; i < geometries.size(); i++) {
+            if (geometries[i].name == name) {
+                geometries[i].users++;
+                return (GeometryHandle)i;
+            }
+        }
+        return INVALID_GEOMETRY;
+    }
+
+    GeometryHandle add(const std::string& name, const GLfloat* shapeVertices, size_t vertexCount,
+                       const uint32_t* shapeIndices, size_t indexCount) {
+        if (VAO == 0) {
+            create();
+        }
+        Geometry geometry;
+        geometry.name = name;
+        geometry.indexCount = (GLsizei)indexCount;
+        geometry.firstIndex = (GLuint)indices.size();
+        geometry.baseVertex = (GLint)(vertices.size() / 8);
+        geometry.vertexCount = (GLsizei)vertexCount;
+        geometry.bytes = (GLsizeiptr)(vertexCount * 8 * sizeof(GLfloat) + indexCount * sizeof(uint32_t));
+        geometry.users = 1;
+        for (size_t i = 0; i < vertexCount; i++) {
+            geometry.bounds.add(glm::vec3(shapeVertices[i * 8], shapeVertices[i * 8 + 1], shapeVertices[i * 8 + 2]));
+        }
+        vertices.insert(vertices.end(), shapeVertices, shapeVertices + vertexCount * 8);
+        indices.insert(indices.end(), shapeIndices, shapeIndices + indexCount);
+        dirty = true;
+
+        geometries.push_back(geometry);
+        return (GeometryHandle)(geometries.size() - 1);
+    }
+
+    // Creates the shared VAO with its attributes pointing at the (still empty) shared buffers
+    void create() {
+        multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        // Position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
+        glEnableVertexAttribArray(0);
+        // Normal attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+        // TexCoord attribute
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        // Without multi-draw the draw index is set as a constant attribute before each draw instead
+        if (multiDraw) {
+            std::vector<GLuint> drawIndices(DrawRing::RECORDS_PER_WINDOW);
+            for (size_t i = 0; i < drawIndices.size(); i++) {
+                drawIndices[i] = (GLuint)i;
+            }
+            glGenBuffers(1, &drawIndexVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, drawIndexVBO);
+            glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLuint), drawIndices.data(), GL_STATIC_DRAW);
+            glVertexAttribIPointer(DRAW_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+            glEnableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+            glVertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+        }
+
+        // Unbind the VAO
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        boundVAO = 0;
+    }
+
+    // Replaces the contents of the shared buffers with every shape added so far
+    void upload() {
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // The element buffer binding belongs to the VAO, bind it there
+        glBindVertexArray(VAO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        boundVAO = 0;
+        dirty = false;
+    }
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*Instanced group class*/
+
+#ifndef INSTANCED_GROUP_H
+#define INSTANCED_GROUP_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "GeometryRegistry.h"
+#include "TextureCache.h"
+#include "RenderQueue.h"
+
+// Per-instance data, read by Project5.vs at attribute locations 3 to 11
+struct InstanceData {
+    glm::mat4 model;    // Locations 3-6
+    glm::vec4 color;    // Location 7, alpha in w
+    glm::vec2 params;   // Location 8, texture array layer (-1 for none) and brighter flag
+    glm::mat3 normal;   // Locations 9-11, inverse transpose of the model matrix
+};
+
+// Draws a group of objects that share one shape with a single glDrawElementsInstancedBaseVertex call
+class InstancedGroup {
+public:
+    GLuint VAO = 0, instanceVBO = 0;
+    GLuint textureArray = 0;
+    GLsizei indexCount = 0, instanceCount = 0;
+    GLuint firstIndex = 0;
+    GLint baseVertex = 0;
+
+    // Packs the opaque objects into the instance buffer and their textures into a texture array.
+    // Transparent objects are left out so they can be depth sorted on their own.
+    // T needs geometry, color, textureID and transform like Cube and wiiGame.
+    template <typename T>
+    void build(const std::vector<T>& objects, bool brighter, GeometryRegistry& registry, TextureCache& textures) {
+        destroy(textures);
+        if (objects.empty()) {
+            return;
+        }
+
+        std::vector<std::string> layers;
+        pack(objects, brighter, textures, layers);
+        shown.assign(instances.size(), 1);
+        builtVersion = version(objects);
+        builtBrighter = brighter;
+        if (instances.empty()) {
+            return;
+        }
+        if (!layers.empty()) {
+            textureArray = textures.acquireArray(layers);
+        }
+
+        const Geometry& geometry = registry.get(objects[0].geometry);
+        indexCount = geometry.indexCount;
+        firstIndex = geometry.firstIndex;
+        baseVertex = geometry.baseVertex;
+        instanceCount = (GLsizei)instances.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+
+        // Per-vertex attributes and indices come from the registry's shared buffers
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, registry.EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, registry.VBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+
+        // Per-instance attributes advance once per instance
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STATIC_DRAW);
+        for (int column = 0; column < 4; column++) {
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribDivisor(3 + column, 1);
+        }
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)offsetof(InstanceData, color));
+        glEnableVertexAttribArray(7);
+        glVertexAttribDivisor(7, 1);
+        glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)offsetof(InstanceData, params));
+        glEnableVertexAttribArray(8);
+        glVertexAttribDivisor(8, 1);
+        for (int column = 0; column < 3; column++) {
+            glVertexAttribPointer(9 + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid*)(offsetof(InstanceData, normal) + column * sizeof(glm::vec3)));
+            glEnableVertexAttribArray(9 + column);
+            glVertexAttribDivisor(9 + column, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Repacks the instances if any object's transform changed since they were packed
+    template <typename T>
+    void refresh(const std::vector<T>& objects, TextureCache& textures) {
+        unsigned long current = version(objects);
+        if (current == builtVersion || instances.empty()) {
+            return;
+        }
+        std::vector<std::string> layers;
+        pack(objects, builtBrighter, textures, layers);
+        builtVersion = current;
+        // Force the next cull() to upload the new data
+        shown.assign(instances.size(), 2);
+    }
+
+    // Keeps only the instances whose object is visible, visible[i] belongs to the group's object i.
+    // The instance buffer is only rewritten when the visible set changes.
+    void cull(const char* visible) {
+        bool changed = false;
+        for (size_t i = 0; i < instances.size(); i++) {
+            char seen = visible[instanceObjects[i]] ? 1 : 0;
+            changed = changed || shown[i] != seen;
+            shown[i] = seen;
+        }
+        if (!changed) {
+            return;
+        }
+        std::vector<InstanceData> compacted;
+        for (size_t i = 0; i < instances.size(); i++) {
+            if (shown[i]) {
+                compacted.push_back(instances[i]);
+            }
+        }
+        instanceCount = (GLsizei)compacted.size();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, compacted.size() * sizeof(InstanceData), compacted.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Describes the single instanced draw of the group for the render queue
+    DrawItem drawItem(const Shader& shader) const {
+        DrawItem item;
+        item.program = shader.Program;
+        item.VAO = VAO;
+        item.texture = textureArray;
+        item.textureTarget = GL_TEXTURE_2D_ARRAY;
+        item.count = indexCount;
+        item.firstIndex = firstIndex;
+        item.baseVertex = baseVertex;
+        item.instanceCount = instanceCount;
+        return item;
+    }
+
+    // Deletes the group's buffers and releases its texture array
+    void destroy(TextureCache& textures) {
+        if (VAO != 0) {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &instanceVBO);
+        }
+        if (textureArray != 0) {
+            textures.release(textureArray);
+        }
+        VAO = instanceVBO = textureArray = 0;
+        indexCount = instanceCount = 0;
+        instances.clear();
+        instanceObjects.clear();
+        shown.clear();
+    }
+
+private:
+    // Sum of the objects' transform versions when the instance buffer was packed
+    unsigned long builtVersion = 0;
+    bool builtBrighter = false;
+
+    // Every packed instance, the object it came from and whether it is in the instance buffer
+    std::vector<InstanceData> instances;
+    std::vector<uint32_t> instanceObjects;
+    std::vector<char> shown;
+
+    template <typename T>
+    static unsigned long version(const std::vector<T>& objects) {
+        // Versions only grow, so the sum changes whenever any transform changes
+        unsigned long sum = 0;
+        for (const auto& object : objects) {
+            sum += object.transform.version();
+        }
+        return sum;
+    }
+
+    // Builds the instance data of the opaque objects, giving every distinct texture its own layer
+    template <typename T>
+    void pack(const std::vector<T>& objects, bool brighter, TextureCache& textures, std::vector<std::string>& layers) {
+        instances.clear();
+        instanceObjects.clear();
+        for (size_t index = 0; index < objects.size(); index++) {
+            const T& object = objects[index];
+            if (object.color.w < 1.0f) {
+                continue;
+            }
+            InstanceData instance;
+            instance.model = object.transform.world();
+            instance.normal = object.transform.normal();
+            instance.color = object.color;
+            instance.params = glm::vec2(-1.0f, brighter ? 1.0f : 0.0f);
+            if (object.textureID != (GLuint)-1) {
+                std::string path = textures.pathOf(object.textureID);
+                auto found = std::find(layers.begin(), layers.end(), path);
+                instance.params.x = (float)(found - layers.begin());
+                if (found == layers.end()) {
+                    layers.push_back(path);
+                }
+            }
+            instances.push_back(instance);
+            instanceObjects.push_back((uint32_t)index);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,181 @@
+/*Job system class*/
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+
+// Counts the unfinished jobs of one batch of work, wait on it with JobSystem::wait()
+struct JobGroup {
+    std::atomic<long> pending{0};
+};
+
+// Runs small jobs on one worker thread per core. Every thread has its own deque: it takes new work from
+// the back of its own deque and, when that is empty, steals the oldest job from the front of another's.
+// The thread that created the system counts as worker 0 and runs jobs while it waits.
+class JobSystem {
+public:
+    explicit JobSystem(unsigned int threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, threads);
+        for (unsigned int i = 0; i < threads; i++) {
+            queues.emplace_back(new Queue());
+        }
+        for (unsigned int i = 1; i < threads; i++) {
+            workers.emplace_back(&JobSystem::work, this, (int)i);
+        }
+    }
+
+    ~JobSystem() {
+        destroy();
+    }
+
+    // Stops the worker threads, every job must have finished
+    void destroy() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    unsigned int threadCount() const {
+        return (unsigned int)queues.size();
+    }
+
+    // Queues a job on the calling thread's deque
+    void run(JobGroup& group, std::function<void()> work) {
+        group.pending++;
+        Queue& queue = *queues[currentWorker()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(Job{ std::move(work), &group });
+        }
+        {
+            // Taking the lock orders the new job before any worker going to sleep
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    // Calls body(begin, end) for ranges of at most grain items covering [0, count), spread across the workers
+    void parallelFor(JobGroup& group, size_t count, size_t grain, std::function<void(size_t, size_t)> body) {
+        grain = std::max<size_t>(1, grain);
+        auto shared = std::make_shared<std::function<void(size_t, size_t)>>(std::move(body));
+        for (size_t begin = 0; begin < count; begin += grain) {
+            size_t end = std::min(count, begin + grain);
+            run(group, [shared, begin, end] { (*shared)(begin, end); });
+        }
+    }
+
+    // Runs jobs until every job of the group has finished
+    void wait(JobGroup& group) {
+        int self = currentWorker();
+        while (group.pending.load() > 0) {
+            if (!runOne(self)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Prints how many jobs ran and how many of them were stolen
+    void report() const {
+        if (executed > 0) {
+            std::cout << "Job system: " << executed << " jobs on " << threadCount() << " threads, "
+                      << stolen << " stolen" << std::endl;
+        }
+    }
+
+private:
+    struct Job {
+        std::function<void()> work;
+        JobGroup* group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    long queued = 0;            // Jobs waiting in any deque, guarded by sleepMutex
+    bool stopping = false;
+    std::atomic<long> executed{0}, stolen{0};
+
+    // Index of the calling thread's deque, 0 for every thread that is not a worker
+    static int& currentWorker() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    void work(int index) {
+        currentWorker() = index;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+                if (stopping) {
+                    return;
+                }
+            }
+            while (runOne(index)) {
+            }
+        }
+    }
+
+    // Runs the newest job of the thread's own deque or steals the oldest job of another, false if all were empty
+    bool runOne(int self) {
+        Job job;
+        bool found = take(*queues[self], job, false);
+        for (size_t i = 1; !found && i < queues.size(); i++) {
+            found = take(*queues[(self + i) % queues.size()], job, true);
+            if (found) {
+                stolen++;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued--;
+        }
+        job.work();
+        executed++;
+        job.group->pending--;
+        return true;
+    }
+
+    static bool take(Queue& queue, Job& job, bool front) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            return false;
+        }
+        if (front) {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        } else {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        return true;
+    }
+};
+
+#endif
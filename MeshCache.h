@@ -0,0 +1,310 @@
+/*Mesh cache class*/
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/stat.h>
+
+// Assimp includes
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// Vertex layout shared with the primitive shapes: position, normal, texture coordinates
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+};
+
+// An indexed triangle mesh stored the way it is uploaded: the indices followed by the vertices
+struct MeshData {
+    std::vector<unsigned char> bytes;
+    uint32_t indexCount = 0, vertexCount = 0;
+
+    // Where the vertices start in bytes
+    size_t vertexOffset() const {
+        return (size_t)indexCount * sizeof(uint32_t);
+    }
+};
+
+// Imports model files with Assimp once and keeps the optimized result in a .mesh file next to the model.
+// Later loads read that file directly and skip Assimp, until the model file changes.
+class MeshCache {
+public:
+    static bool load(const std::string& path, MeshData& mesh) {
+        std::string meshPath = path.substr(0, path.find_last_of('.')) + ".mesh";
+        struct stat source;
+        if (stat(path.c_str(), &source) != 0) {
+            std::cerr << "ERROR::MESH::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        if (read(meshPath, source, mesh)) {
+            return true;
+        }
+        if (!import(path, mesh)) {
+            return false;
+        }
+        write(meshPath, source, mesh);
+        return true;
+    }
+
+private:
+    static const uint32_t VERSION = 1;
+    static const int CACHE_SIZE = 32;
+
+    // Start of a .mesh file, followed by the bytes of MeshData
+    struct FileHeader {
+        char magic[4];          // "MSH1"
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint32_t indexCount;
+        uint32_t vertexCount;
+    };
+
+    // Reads a baked mesh, fails if it is missing or was made from another version of the model
+    static bool read(const std::string& meshPath, const struct stat& source, MeshData& mesh) {
+        std::ifstream file(meshPath, std::ios::binary);
+        FileHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, "MSH1", 4) != 0 ||
+            header.version != VERSION || header.sourceSize != (uint64_t)source.st_size ||
+            header.sourceTime != (int64_t)source.st_mtime) {
+            return false;
+        }
+        mesh.indexCount = header.indexCount;
+        mesh.vertexCount = header.vertexCount;
+        mesh.bytes.resize(mesh.vertexOffset() + (size_t)mesh.vertexCount * sizeof(MeshVertex));
+        return (bool)file.read((char*)mesh.bytes.data(), mesh.bytes.size());
+    }
+
+    static void write(const std::string& meshPath, const struct stat& source, const MeshData& mesh) {
+        FileHeader header;
+        std::memcpy(header.magic, "MSH1", 4);
+        header.version = VERSION;
+        header.sourceSize = (uint64_t)source.st_size;
+        header.sourceTime = (int64_t)source.st_mtime;
+        header.indexCount = mesh.indexCount;
+        header.vertexCount = mesh.vertexCount;
+        std::ofstream file(meshPath, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)mesh.bytes.data(), mesh.bytes.size());
+    }
+
+    // Imports every mesh of the model into one welded, cache optimized triangle list
+    static bool import(const std::string& path, MeshData& mesh) {
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs |
+                                                 aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals);
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+            std::cerr << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        std::vector<MeshVertex> vertices;
+        std::vector<uint32_t> indices;
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+            aiMesh *part = scene->mMeshes[i];
+            uint32_t baseVertex = (uint32_t)vertices.size();
+            for (unsigned int j = 0; j < part->mNumVertices; j++) {
+                MeshVertex vertex = {};
+                vertex.position[0] = part->mVertices[j].x;
+                vertex.position[1] = part->mVertices[j].y;
+                vertex.position[2] = part->mVertices[j].z;
+                if (part->mNormals) {
+                    vertex.normal[0] = part->mNormals[j].x;
+                    vertex.normal[1] = part->mNormals[j].y;
+                    vertex.normal[2] = part->mNormals[j].z;
+                }
+                if (part->mTextureCoords[0]) {
+                    vertex.texCoord[0] = part->mTextureCoords[0][j].x;
+                    vertex.texCoord[1] = part->mTextureCoords[0][j].y;
+                }
+                vertices.push_back(vertex);
+            }
+            for (unsigned int j = 0; j < part->mNumFaces; j++) {
+                const aiFace& face = part->mFaces[j];
+                // Triangulation leaves points and lines as they are
+                if (face.mNumIndices != 3) {
+                    continue;
+                }
+                for (unsigned int k = 0; k < 3; k++) {
+                    indices.push_back(baseVertex + face.mIndices[k]);
+                }
+            }
+        }
+
+        float before = missRatio(indices, vertices.size());
+        optimizeVertexCache(indices, vertices.size());
+        optimizeVertexFetch(vertices, indices);
+        std::cout << "Imported mesh: " << path << ", " << vertices.size() << " vertices, " << indices.size() / 3
+                  << " triangles, " << before << " -> " << missRatio(indices, vertices.size())
+                  << " vertex cache misses per triangle" << std::endl;
+
+        mesh.indexCount = (uint32_t)indices.size();
+        mesh.vertexCount = (uint32_t)vertices.size();
+        mesh.bytes.resize(mesh.vertexOffset() + vertices.size() * sizeof(MeshVertex));
+        std::memcpy(mesh.bytes.data(), indices.data(), mesh.vertexOffset());
+        std::memcpy(mesh.bytes.data() + mesh.vertexOffset(), vertices.data(), vertices.size() * sizeof(MeshVertex));
+        return true;
+    }
+
+    // Tom Forsyth's linear-speed vertex cache optimization: greedily emits the triangle whose
+    // vertices score best, favouring vertices already in the cache and ones with few triangles left
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // Triangles that use each vertex
+        std::vector<uint32_t> first(vertexCount + 1, 0), adjacency(indices.size());
+        for (uint32_t index : indices) {
+            first[index + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            first[v + 1] += first[v];
+        }
+        std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+        }
+
+        std::vector<int> remaining(vertexCount), cachePosition(vertexCount, -1);
+        for (size_t v = 0; v < vertexCount; v++) {
+            remaining[v] = (int)(first[v + 1] - first[v]);
+        }
+        auto vertexScore = [&](uint32_t v) {
+            if (remaining[v] == 0) {
+                return -1.0f;
+            }
+            float score = 0.0f;
+            int position = cachePosition[v];
+            if (position >= 0) {
+                // The last triangle's vertices score the same so no single winding is preferred
+                score = position < 3 ? 0.75f : std::pow(1.0f - (position - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+            }
+            return score + 2.0f * std::pow((float)remaining[v], -0.5f);
+        };
+
+        std::vector<float> vertexScores(vertexCount), triangleScores(triangleCount, 0.0f);
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScores[v] = vertexScore((uint32_t)v);
+        }
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                triangleScores[t] += vertexScores[indices[t * 3 + k]];
+            }
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> output, cache;
+        output.reserve(indices.size());
+        size_t cursor = 0;
+        while (output.size() < indices.size()) {
+            // Best triangle touching the cache, or the next unemitted one if the cache has none
+            long best = -1;
+            float bestScore = -1.0f;
+            for (uint32_t v : cache) {
+                for (uint32_t a = first[v]; a < first[v + 1]; a++) {
+                    uint32_t t = adjacency[a];
+                    if (!emitted[t] && triangleScores[t] > bestScore) {
+                        best = t;
+                        bestScore = triangleScores[t];
+                    }
+                }
+            }
+            if (best < 0) {
+                while (emitted[cursor]) {
+                    cursor++;
+                }
+                best = (long)cursor;
+            }
+
+            emitted[best] = true;
+            std::vector<uint32_t> newCache;
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[best * 3 + k];
+                output.push_back(v);
+                remaining[v]--;
+                if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                    newCache.push_back(v);
+                }
+            }
+            for (uint32_t v : cache) {
+                if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                    newCache.push_back(v);
+                }
+            }
+
+            // Rescore the vertices whose cache position changed and the triangles around them
+            for (size_t i = 0; i < newCache.size(); i++) {
+                cachePosition[newCache[i]] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+            }
+            for (uint32_t v : newCache) {
+                float score = vertexScore(v);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                for (uint32_t a = first[v]; a < first[v + 1]; a++) {
+                    triangleScores[adjacency[a]] += delta;
+                }
+            }
+            if (newCache.size() > (size_t)CACHE_SIZE) {
+                newCache.resize(CACHE_SIZE);
+            }
+            cache.swap(newCache);
+        }
+        indices.swap(output);
+    }
+
+    // Renumbers the vertices in the order the indices first use them so fetches walk memory forward
+    static void optimizeVertexFetch(std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices) {
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        std::vector<MeshVertex> ordered;
+        ordered.reserve(vertices.size());
+        for (uint32_t& index : indices) {
+            if (remap[index] == UINT32_MAX) {
+                remap[index] = (uint32_t)ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        // Vertices no triangle uses are dropped
+        vertices.swap(ordered);
+    }
+
+    // Average vertex shader runs per triangle with a 16 entry FIFO post-transform cache
+    static float missRatio(const std::vector<uint32_t>& indices, size_t vertexCount) {
+        if (indices.empty()) {
+            return 0.0f;
+        }
+        std::deque<uint32_t> fifo;
+        std::vector<bool> cached(vertexCount, false);
+        size_t misses = 0;
+        for (uint32_t index : indices) {
+            if (cached[index]) {
+                continue;
+            }
+            misses++;
+            fifo.push_back(index);
+            cached[index] = true;
+            if (fifo.size() > 16) {
+                cached[fifo.front()] = false;
+                fifo.pop_front();
+            }
+        }
+        return (float)misses / (indices.size() / 3);
+    }
+};
+
+#endif
@@ -0,0 +1,268 @@
+/*Occlusion culler class*/
+
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cfloat>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define OCCLUSION_USE_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "JobSystem.h"
+
+// Rasterizes large occluders into a small depth buffer on the CPU and tests bounding boxes against it,
+// so objects hidden behind them are never sent to the GPU. Horizontal bands of the buffer are
+// rasterized as separate jobs.
+class OcclusionCuller {
+public:
+    // Depth buffer size, the width is a multiple of 4 so rows split into whole SSE vectors
+    static const int WIDTH = 256, HEIGHT = 192;
+
+    // Rows rasterized by one job
+    static const int BAND_HEIGHT = 16;
+
+    // Boxes tested and boxes found hidden by the last cull, visible() may be called from several threads
+    std::atomic<long> tested{0}, occluded{0};
+
+    OcclusionCuller() : depth(WIDTH * HEIGHT, 1.0f) {
+    }
+
+    // Starts a frame seen through viewProjection
+    void begin(const glm::mat4& viewProjection) {
+        this->viewProjection = viewProjection;
+        quads.clear();
+        tested = 0;
+        occluded = 0;
+    }
+
+    // Adds the 6 faces of the unit cube transformed by model as an occluder
+    void addBox(const glm::mat4& model) {
+        // Corners of each face in order around it
+        static const int faces[6][4] = {
+            {0, 1, 3, 2}, {4, 6, 7, 5},     // -x, +x
+            {0, 4, 5, 1}, {2, 3, 7, 6},     // -y, +y
+            {0, 2, 6, 4}, {1, 5, 7, 3}      // -z, +z
+        };
+        glm::mat4 toClip = viewProjection * model;
+        ScreenVertex corners[8];
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 clip = toClip * glm::vec4(i & 4 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 1 ? 0.5f : -0.5f, 1.0f);
+            corners[i] = toScreen(clip);
+        }
+        for (const auto& face : faces) {
+            // Faces crossing the near plane are left out, which only makes the occluder smaller
+            if (!corners[face[0]].valid || !corners[face[1]].valid || !corners[face[2]].valid || !corners[face[3]].valid) {
+                continue;
+            }
+            Quad quad = { { corners[face[0]], corners[face[1]], corners[face[2]], corners[face[3]] } };
+            quads.push_back(quad);
+        }
+    }
+
+    // Clears the depth buffer and rasterizes every occluder added since begin()
+    void rasterize(JobSystem& jobs) {
+        JobGroup bands;
+        jobs.parallelFor(bands, (HEIGHT + BAND_HEIGHT - 1) / BAND_HEIGHT, 1, [this](size_t begin, size_t end) {
+            for (size_t band = begin; band < end; band++) {
+                rasterizeBand((int)band);
+            }
+        });
+        jobs.wait(bands);
+    }
+
+    // Returns false if the box is certainly hidden behind the occluders, safe to call from several threads after rasterize()
+    bool visible(const AABB& box) {
+        tested++;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner(i & 4 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 1 ? box.max.z : box.min.z);
+            ScreenVertex vertex = toScreen(viewProjection * glm::vec4(corner, 1.0f));
+            // Boxes reaching behind the camera are kept
+            if (!vertex.valid) {
+                return true;
+            }
+            minX = std::min(minX, vertex.x);
+            maxX = std::max(maxX, vertex.x);
+            minY = std::min(minY, vertex.y);
+            maxY = std::max(maxY, vertex.y);
+            nearest = std::min(nearest, vertex.z);
+        }
+        int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(WIDTH - 1, (int)std::ceil(maxX));
+        int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(HEIGHT - 1, (int)std::ceil(maxY));
+        if (x0 > x1 || y0 > y1) {
+            return true;
+        }
+
+        // Visible as soon as one pixel of the box's screen rectangle is farther away than its nearest point
+        for (int y = y0; y <= y1; y++) {
+            const float* row = &depth[y * WIDTH];
+#ifdef OCCLUSION_USE_SSE
+            __m128 boxDepth = _mm_set1_ps(nearest);
+            __m128 first = _mm_set1_ps((float)x0), last = _mm_set1_ps((float)x1);
+            for (int x = x0 & ~3; x <= x1; x += 4) {
+                __m128 lane = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(lane, first), _mm_cmple_ps(lane, last));
+                __m128 farther = _mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth);
+                if (_mm_movemask_ps(_mm_and_ps(inside, farther))) {
+                    return true;
+                }
+            }
+#else
+            for (int x = x0; x <= x1; x++) {
+                if (row[x] >= nearest) {
+                    return true;
+                }
+            }
+#endif
+        }
+        occluded++;
+        return false;
+    }
+
+    // Prints the average number of tested and hidden boxes per frame
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Occlusion culling: " << (double)totalTested / frames << " boxes tested and "
+                      << (double)totalOccluded / frames << " hidden per frame" << std::endl;
+        }
+    }
+
+    // Adds the last cull to the report
+    void endFrame() {
+        frames++;
+        totalTested += tested;
+        totalOccluded += occluded;
+    }
+
+private:
+    // A vertex in depth buffer pixels with its normalized device depth
+    struct ScreenVertex {
+        float x, y, z;
+        bool valid;     // False if the vertex is behind the near plane
+    };
+
+    // A box face is drawn whole rather than as two triangles, so no pixel can slip between them
+    struct Quad {
+        ScreenVertex v[4];
+    };
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<Quad> quads;
+    std::vector<float> depth;     // Normalized device depth, 1 is the far plane
+
+    long frames = 0, totalTested = 0, totalOccluded = 0;
+
+    static ScreenVertex toScreen(const glm::vec4& clip) {
+        ScreenVertex vertex;
+        vertex.valid = clip.w > 1e-5f && clip.z > -clip.w;
+        float w = vertex.valid ? clip.w : 1.0f;
+        vertex.x = (clip.x / w * 0.5f + 0.5f) * WIDTH;
+        vertex.y = (clip.y / w * 0.5f + 0.5f) * HEIGHT;
+        vertex.z = clip.z / w;
+        return vertex;
+    }
+
+    // Clears rows [band * BAND_HEIGHT, (band + 1) * BAND_HEIGHT) and rasterizes every face into them
+    void rasterizeBand(int band) {
+        int top = band * BAND_HEIGHT, bottom = std::min(HEIGHT, top + BAND_HEIGHT);
+        std::fill(depth.begin() + top * WIDTH, depth.begin() + bottom * WIDTH, 1.0f);
+        for (const auto& quad : quads) {
+            rasterizeQuad(quad, top, bottom);
+        }
+    }
+
+    static float edge(const ScreenVertex& a, const ScreenVertex& b, float x, float y) {
+        return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    }
+
+    // Half-space rasterization of a convex quad at pixel centers, keeping the nearest depth per pixel
+    void rasterizeQuad(const Quad& quad, int top, int bottom) {
+        ScreenVertex v[4] = { quad.v[0], quad.v[1], quad.v[2], quad.v[3] };
+        // Depth is linear in screen space, take its gradient from the first three corners
+        float area = edge(v[0], v[1], v[2].x, v[2].y);
+        if (std::fabs(area) < 1e-6f) {
+            return;
+        }
+        // Wind every face the same way so inside means all edge functions are positive
+        if (area < 0.0f) {
+            std::swap(v[1], v[3]);
+            area = -area;
+        }
+        float dzdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+        float dzdy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+
+        float minX = v[0].x, maxX = v[0].x, minY = v[0].y, maxY = v[0].y;
+        for (int i = 1; i < 4; i++) {
+            minX = std::min(minX, v[i].x);
+            maxX = std::max(maxX, v[i].x);
+            minY = std::min(minY, v[i].y);
+            maxY = std::max(maxY, v[i].y);
+        }
+        int x0 = std::max(0, (int)std::floor(minX)) & ~3, x1 = std::min(WIDTH - 1, (int)std::ceil(maxX));
+        int y0 = std::max(top, (int)std::floor(minY)), y1 = std::min(bottom - 1, (int)std::ceil(maxY));
+        if (x0 > x1 || y0 > y1) {
+            return;
+        }
+
+        // Edge function steps per pixel in x
+        float step[4];
+        for (int i = 0; i < 4; i++) {
+            step[i] = -(v[(i + 1) & 3].y - v[i].y);
+        }
+
+        for (int y = y0; y <= y1; y++) {
+            float py = y + 0.5f, px = x0 + 0.5f;
+            float e[4];
+            for (int i = 0; i < 4; i++) {
+                e[i] = edge(v[i], v[(i + 1) & 3], px, py);
+            }
+            float z = v[0].z + dzdx * (px - v[0].x) + dzdy * (py - v[0].y);
+            float* row = &depth[y * WIDTH];
+#ifdef OCCLUSION_USE_SSE
+            __m128 steps = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), zero = _mm_setzero_ps();
+            __m128 e0 = _mm_add_ps(_mm_set1_ps(e[0]), _mm_mul_ps(steps, _mm_set1_ps(step[0])));
+            __m128 e1 = _mm_add_ps(_mm_set1_ps(e[1]), _mm_mul_ps(steps, _mm_set1_ps(step[1])));
+            __m128 e2 = _mm_add_ps(_mm_set1_ps(e[2]), _mm_mul_ps(steps, _mm_set1_ps(step[2])));
+            __m128 e3 = _mm_add_ps(_mm_set1_ps(e[3]), _mm_mul_ps(steps, _mm_set1_ps(step[3])));
+            __m128 zs = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(steps, _mm_set1_ps(dzdx)));
+            __m128 step0 = _mm_set1_ps(4.0f * step[0]), step1 = _mm_set1_ps(4.0f * step[1]);
+            __m128 step2 = _mm_set1_ps(4.0f * step[2]), step3 = _mm_set1_ps(4.0f * step[3]), stepZ = _mm_set1_ps(4.0f * dzdx);
+            for (int x = x0; x <= x1; x += 4) {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                           _mm_and_ps(_mm_cmpge_ps(e2, zero), _mm_cmpge_ps(e3, zero)));
+                if (_mm_movemask_ps(inside)) {
+                    __m128 stored = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_and_ps(inside, _mm_cmplt_ps(zs, stored));
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(nearer, zs), _mm_andnot_ps(nearer, stored)));
+                }
+                e0 = _mm_add_ps(e0, step0);
+                e1 = _mm_add_ps(e1, step1);
+                e2 = _mm_add_ps(e2, step2);
+                e3 = _mm_add_ps(e3, step3);
+                zs = _mm_add_ps(zs, stepZ);
+            }
+#else
+            for (int x = x0; x <= x1; x++, z += dzdx) {
+                if (e[0] >= 0.0f && e[1] >= 0.0f && e[2] >= 0.0f && e[3] >= 0.0f) {
+                    row[x] = std::min(row[x], z);
+                }
+                for (int i = 0; i < 4; i++) {
+                    e[i] += step[i];
+                }
+            }
+#endif
+        }
+    }
+};
+
+#endif
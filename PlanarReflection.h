@@ -0,0 +1,174 @@
+/*Planar reflection class*/
+
+#ifndef PLANAR_REFLECTION_H
+#define PLANAR_REFLECTION_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// Mirror image of the scene in one plane, drawn into a texture at a fraction of the window's resolution.
+// The scene is drawn again through the camera reflected in the plane, with the objects behind the plane
+// culled on the CPU and the rest clipped against it in the vertex shader. To keep it a small, fixed part of
+// the frame it is only redrawn rate times a second, or only when the camera moved when rate is 0.
+class PlanarReflection {
+public:
+    // Texture unit of the reflectionMap sampler
+    static const GLint UNIT = 6;
+
+    float scale = 0.5f;     // Fraction of the window's width and height the reflection is drawn at
+    float rate = 10.0f;     // Redraws per second, 0 redraws only when the camera moves
+
+    // Set by due(): the view through the mirrored camera, where that camera is, and the plane as the
+    // clipPlane uniform, positive on the side the camera looks from
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec4 plane = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+    // Makes the texture for a window of width x height pixels
+    void create(int width, int height) {
+        destroy();
+        this->width = std::max(1, (int)(width * scale));
+        this->height = std::max(1, (int)(height * scale));
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, this->width, this->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, this->width, this->height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR::REFLECTION::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        }
+        // Start out empty rather than with whatever the driver left in the texture
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Sets the mirror from a point on it and the direction its reflecting side faces
+    void setPlane(const glm::vec3& point, const glm::vec3& normal) {
+        glm::vec3 n = glm::normalize(normal);
+        plane = glm::vec4(n, -glm::dot(n, point));
+        // Householder reflection through the plane
+        reflect = glm::mat4(1.0f);
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                reflect[column][row] -= 2.0f * n[column] * n[row];
+            }
+            reflect[3][column] = -2.0f * plane.w * n[column];
+        }
+    }
+
+    // Whether the reflection should be redrawn this frame for a camera at cameraPos looking through cameraView.
+    // Never while the camera is behind the mirror, where it cannot see it.
+    bool due(const glm::mat4& cameraView, const glm::vec3& cameraPos) {
+        frames++;
+        if (texture == 0 || glm::dot(glm::vec3(plane), cameraPos) + plane.w <= 0.0f) {
+            return false;
+        }
+        auto now = std::chrono::steady_clock::now();
+        bool redraw = updates == 0;
+        if (rate > 0.0f) {
+            redraw = redraw || std::chrono::duration<float>(now - lastUpdate).count() >= 1.0f / rate;
+        } else {
+            redraw = redraw || cameraView != lastView;
+        }
+        if (!redraw) {
+            return false;
+        }
+        lastUpdate = now;
+        lastView = cameraView;
+        view = cameraView * reflect;
+        position = glm::vec3(reflect * glm::vec4(cameraPos, 1.0f));
+        updates++;
+        return true;
+    }
+
+    // Drops the objects that are completely behind the mirror from visible, which is indexed like bounds
+    void cull(const std::vector<AABB>& bounds, std::vector<char>& visible) const {
+        glm::vec3 n(plane);
+        for (size_t i = 0; i < bounds.size(); i++) {
+            if (visible[i]) {
+                glm::vec3 extent = bounds[i].extent();
+                float radius = std::fabs(n.x) * extent.x + std::fabs(n.y) * extent.y + std::fabs(n.z) * extent.z;
+                visible[i] = glm::dot(n, bounds[i].center()) + plane.w + radius >= 0.0f;
+            }
+        }
+    }
+
+    // Starts drawing the reflection, with the clip plane on and the texture unbound so it is not read while drawn
+    void begin() {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glActiveTexture(GL_TEXTURE0 + UNIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_CLIP_DISTANCE0);
+    }
+
+    // Finishes the reflection and goes back to the framebuffer and viewport from before it
+    void end() {
+        glDisable(GL_CLIP_DISTANCE0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, savedFramebuffer);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    void bind() const {
+        glActiveTexture(GL_TEXTURE0 + UNIT);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Prints how often the reflection was redrawn
+    void report() const {
+        if (texture != 0 && frames > 0) {
+            std::cout << "Planar reflection: " << width << " x " << height << " texels, redrawn in " << updates << " of "
+                      << frames << " frames (" << 100.0 * updates / frames << "%)" << std::endl;
+        }
+    }
+
+    void destroy() {
+        if (texture != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &depth);
+            glDeleteTextures(1, &texture);
+            framebuffer = depth = texture = 0;
+        }
+    }
+
+private:
+    GLuint framebuffer = 0, texture = 0, depth = 0;
+    int width = 0, height = 0;
+    glm::mat4 reflect = glm::mat4(1.0f);
+    glm::mat4 lastView = glm::mat4(1.0f);
+    std::chrono::steady_clock::time_point lastUpdate;
+    GLint savedFramebuffer = 0;
+    GLint savedViewport[4] = { 0, 0, 0, 0 };
+    long frames = 0, updates = 0;
+};
+
+#endif
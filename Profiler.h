@@ -0,0 +1,228 @@
+/*Profiler class*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include <GL/glew.h>
+
+// Times named scopes of each frame on the CPU and the GPU and writes them as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). Does nothing until start() is called.
+class Profiler {
+public:
+    bool enabled = false;
+
+    // Turns profiling on, needs a current OpenGL context
+    void start() {
+        enabled = true;
+        cpuOrigin = std::chrono::steady_clock::now();
+        // Line the GPU clock up with the CPU clock so both tracks share a timeline
+        GLint64 now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &now);
+        gpuOrigin = now;
+    }
+
+    void beginFrame() {
+        if (!enabled) {
+            return;
+        }
+        int slot = frameIndex % RING_SIZE;
+        // The queries in this slot were issued RING_SIZE frames ago, so reading them rarely waits
+        collect(slot);
+        slots[slot].frame = frameIndex;
+        push("Frame");
+    }
+
+    void endFrame() {
+        if (!enabled) {
+            return;
+        }
+        endGpu();
+        pop();
+        frameIndex++;
+    }
+
+    // Starts a CPU scope, scopes nest
+    void push(const char* name) {
+        if (enabled) {
+            open.push_back(std::make_pair(name, std::chrono::steady_clock::now()));
+        }
+    }
+
+    void pop() {
+        if (!enabled || open.empty()) {
+            return;
+        }
+        double start = microseconds(open.back().second);
+        Event event = { open.back().first, start, microseconds(std::chrono::steady_clock::now()) - start, CPU_TRACK, frameIndex };
+        events.push_back(event);
+        open.pop_back();
+    }
+
+    // Starts a GPU scope, ending the one before it. GPU scopes do not nest.
+    void beginGpu(const char* name) {
+        if (!enabled) {
+            return;
+        }
+        endGpu();
+        Slot& slot = slots[frameIndex % RING_SIZE];
+        if (slot.used + 2 > slot.queries.size()) {
+            size_t first = slot.queries.size();
+            slot.queries.resize(first + 32);
+            glGenQueries(32, &slot.queries[first]);
+        }
+        GpuScope scope = { name, slot.queries[slot.used], slot.queries[slot.used + 1] };
+        slot.used += 2;
+        slot.scopes.push_back(scope);
+        glQueryCounter(scope.begin, GL_TIMESTAMP);
+        gpuOpen = true;
+    }
+
+    void endGpu() {
+        if (enabled && gpuOpen) {
+            glQueryCounter(slots[frameIndex % RING_SIZE].scopes.back().end, GL_TIMESTAMP);
+            gpuOpen = false;
+        }
+    }
+
+    // Reads every outstanding query, call after the last frame
+    void finish() {
+        if (!enabled) {
+            return;
+        }
+        // Oldest frame first so the trace stays in order
+        for (int i = 0; i < RING_SIZE; i++) {
+            collect((frameIndex + i) % RING_SIZE);
+        }
+    }
+
+    // Writes every recorded scope as Chrome trace events
+    bool writeTrace(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+        file << "{\"traceEvents\":[\n"
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << CPU_TRACK << ",\"args\":{\"name\":\"CPU\"}},\n"
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_TRACK << ",\"args\":{\"name\":\"GPU\"}}";
+        for (const auto& event : events) {
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+                 << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+                 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return true;
+    }
+
+    // Prints the average CPU and GPU time of every scope per frame
+    void report() const {
+        if (!enabled || frameIndex == 0) {
+            return;
+        }
+        std::map<std::string, double> totals[2];
+        for (const auto& event : events) {
+            totals[event.track == GPU_TRACK][event.name] += event.duration;
+        }
+        std::cout << "Profile (ms per frame):" << std::endl;
+        for (int track = 0; track < 2; track++) {
+            for (const auto& total : totals[track]) {
+                std::cout << "  " << (track ? "GPU " : "CPU ") << total.first << ": " << total.second / 1000.0 / frameIndex << std::endl;
+            }
+        }
+    }
+
+    void destroy() {
+        for (auto& slot : slots) {
+            if (!slot.queries.empty()) {
+                glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+                slot.queries.clear();
+            }
+        }
+    }
+
+private:
+    static const int RING_SIZE = 4;
+    static const int CPU_TRACK = 1, GPU_TRACK = 2;
+
+    // A finished scope, times are in microseconds since start()
+    struct Event {
+        const char* name;
+        double start, duration;
+        int track;
+        long frame;
+    };
+
+    // A GPU scope waiting for its timestamps
+    struct GpuScope {
+        const char* name;
+        GLuint begin, end;
+    };
+
+    // The queries of one frame in flight
+    struct Slot {
+        std::vector<GLuint> queries;
+        size_t used = 0;
+        std::vector<GpuScope> scopes;
+        long frame = -1;
+    };
+
+    Slot slots[RING_SIZE];
+    long frameIndex = 0;
+    bool gpuOpen = false;
+    std::vector<std::pair<const char*, std::chrono::steady_clock::time_point>> open;
+    std::vector<Event> events;
+    std::chrono::steady_clock::time_point cpuOrigin;
+    GLint64 gpuOrigin = 0;
+
+    double microseconds(std::chrono::steady_clock::time_point time) const {
+        return std::chrono::duration<double, std::micro>(time - cpuOrigin).count();
+    }
+
+    void collect(int index) {
+        Slot& slot = slots[index];
+        if (slot.frame < 0) {
+            return;
+        }
+        for (const auto& scope : slot.scopes) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(scope.begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(scope.end, GL_QUERY_RESULT, &end);
+            Event event = { scope.name, ((GLint64)begin - gpuOrigin) / 1000.0, (end - begin) / 1000.0, GPU_TRACK, slot.frame };
+            events.push_back(event);
+        }
+        slot.scopes.clear();
+        slot.used = 0;
+        slot.frame = -1;
+    }
+};
+
+// Times the enclosing block, on the GPU as well when gpu is true
+class ProfileScope {
+public:
+    ProfileScope(Profiler& profiler, const char* name, bool gpu = false) : profiler(profiler), gpu(gpu) {
+        profiler.push(name);
+        if (gpu) {
+            profiler.beginGpu(name);
+        }
+    }
+
+    ~ProfileScope() {
+        if (gpu) {
+            profiler.endGpu();
+        }
+        profiler.pop();
+    }
+
+private:
+    Profiler& profiler;
+    bool gpu;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*Program cache class*/
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+
+// Keeps linked shader programs on disk with glGetProgramBinary so later runs skip compiling and linking.
+// A cached binary is named by a hash of the shader sources and the driver's vendor, renderer and version,
+// so editing a shader or updating the driver makes a new one. Drivers may still reject a binary, the
+// caller then compiles from source as usual.
+class ProgramCache {
+public:
+    // Directory the cache lives in, an empty string turns the cache off
+    static std::string& directory() {
+        static std::string path = ".shader_cache";
+        return path;
+    }
+
+    // Whether the driver can hand out and take back program binaries
+    static bool supported() {
+        if (directory().empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // Hash of the sources and the driver that identifies a program binary
+    static uint64_t keyOf(const std::string& vertexSource, const std::string& fragmentSource) {
+        std::string key = vertexSource + '\0' + fragmentSource;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const GLubyte* value = glGetString(name);
+            key += '\0';
+            key += value ? (const char*)value : "";
+        }
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Loads the cached binary for key into program, false if there is none or the driver rejects it
+    static bool load(uint64_t key, GLuint program) {
+        std::ifstream file(pathOf(key), std::ios::binary);
+        FileHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, "PGB1", 4) != 0 ||
+            header.version != VERSION || header.key != key) {
+            return false;
+        }
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size())) {
+            return false;
+        }
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            // Usually a driver update that kept the version string, the binary is replaced once the program is rebuilt
+            std::cout << "Cached shader program rejected by the driver, compiling from source" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Writes the binary of a linked program under key, replacing any earlier file atomically.
+    // The program should have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+    static bool store(uint64_t key, GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return false;
+        }
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        FileHeader header;
+        std::memcpy(header.magic, "PGB1", 4);
+        header.version = VERSION;
+        header.key = key;
+        header.format = format;
+        header.length = (uint32_t)length;
+
+        mkdir(directory().c_str(), 0755);
+        std::string path = pathOf(key);
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+        file.close();
+        if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const uint32_t VERSION = 1;
+
+    // Start of a cache file, followed by length bytes of program binary
+    struct FileHeader {
+        char magic[4];          // "PGB1"
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;        // Binary format reported by glGetProgramBinary
+        uint32_t length;
+    };
+
+    static std::string pathOf(uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory() + "/" + name;
+    }
+};
+
+#endif
@@ -24,16 +24,36 @@
 #include <vector>
 #include <utility>
 #include <sstream>
+#include <string>
+#include <cstdlib>
+#include <map>
+#include <algorithm>
+#include <random>
 
 #include <SOIL/SOIL.h>
 
 // Other includes
 #include "Shader.h"
 #include "Camera.h"
-
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include "Transform.h"
+#include "GeometryRegistry.h"
+#include "TextureCache.h"
+#include "RenderQueue.h"
+#include "InstancedGroup.h"
+#include "Benchmark.h"
+#include "Scene.h"
+#include "MeshCache.h"
+#include "BoundingVolumeHierarchy.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include "StaticBatch.h"
+#include "TextureAtlas.h"
+#include "ClusteredLights.h"
+#include "ShadowMap.h"
+#include "PlanarReflection.h"
+#include "DynamicResolution.h"
+#include "RedrawTracker.h"
 
 
 // Function prototypes
@@ -41,7 +61,10 @@
 // void do_movement();
 // void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 GLFWwindow* windowInit();
-void SetupOpenGLState(Shader& ourShader, GLint& objectColorLoc, GLint& modelLoc);
+bool headlessInit();
+void renderStateInit();
+void SetupOpenGLState(Shader& ourShader);
+glm::mat4 GetProjectionMatrix();
 
 // Window dimensions
 const GLuint WIDTH = 800, HEIGHT = 600;
@@ -57,6 +80,27 @@ bool    keys[1024];
 
 // Light attributes
 glm::vec3 lightPos(-0.5f, 2.5f, 1.3f);
+// Small point lights from the scene, shaded with clustered forward lighting
+ClusteredLights clusteredLights;
+// Extra random lights scattered through the room, added with --lights <count> to test many lights
+int extraLights = 0;
+// Shadows of the scene light, the static casters are cached and only redrawn when the light or one of them moves
+ShadowMap shadowMap;
+// Collects the shadow casters' draws, separate from renderQueue so it keeps its own draw ring
+RenderQueue shadowQueue;
+// Reflection of the room in the TV screen, its size and update rate are set with --reflection-scale <fraction>
+// and --reflection-rate <per second>, a rate of 0 only updates it when the camera moves
+PlanarReflection reflection;
+// Collects the reflection's draws, separate from renderQueue so it keeps its own draw ring
+RenderQueue reflectionQueue;
+
+// Draws the frame at a lower resolution when it would take more than --frame-budget <ms> of GPU time, down to
+// --min-scale <fraction> of the window's width and height
+DynamicResolution dynamicResolution;
+
+// With --on-demand the window is only drawn when the camera, the light or an object moved, and the loop sleeps
+// in glfwWaitEvents the rest of the time
+RedrawTracker redrawTracker;
 
 // Deltatime
 GLfloat deltaTime = 0.0f;	// Time between current frame and last frame
@@ -64,6 +108,41 @@ GLfloat lastFrame = 0.0f;  	// Time of last frame
 
 bool mouseMovementEnabled = true;
 
+// Shared VAO/VBOs for the primitive shapes
+GeometryRegistry geometryRegistry;
+// Shared textures, each image file is loaded once
+TextureCache textureCache;
+// Small textures of the objects marked atlas in the scene, packed into one texture
+TextureAtlas textureAtlas;
+// Draw the Cube-based groups with one instanced call each
+bool instancedRendering = true;
+// Sorts each frame's draws before issuing them
+RenderQueue renderQueue;
+
+// Headless benchmark, enabled with --benchmark <frames> [--json <file>]
+int benchmarkFrames = 0;        // Frames to render without a window, 0 runs the normal window
+std::string benchmarkOutput;    // File the JSON results are written to, stdout when empty
+HeadlessContext headless;
+
+// Worker threads that prepare each frame's draws, one per core
+JobSystem jobs;
+// Objects handled by one job
+const size_t JOB_GRAIN = 16;
+
+// Hide objects behind the scene's occluders, turned off with --no-occlusion
+bool occlusionCulling = true;
+OcclusionCuller occlusionCuller;
+
+// CPU and GPU timing of each frame, written as a Chrome trace with --trace <file>
+Profiler profiler;
+std::string tracePath;
+
+// Groups whose opaque parts are baked into world space meshes at load time, picked with --bake <group>
+std::vector<std::string> bakedGroups;
+
+// Scene description, baked next to it as a .bin file the first time and whenever it changes
+std::string scenePath = "Scene.txt";
+
 // Camera positions
 std::vector<glm::vec3> cameraPositions = {
     glm::vec3(0.0f, 1.5f, 5.0f),  // Front view
@@ -72,210 +151,122 @@ std::vector<glm::vec3> cameraPositions = {
 };
 int currentCameraIndex = 0;
 
-// Utility functions to convert units
-float inchesToMeters(float inches) {
-    return inches * 0.0254f;
-}
-
-float feetToMeters(float feet) {
-    return feet * 0.3048f;
-}
-
 struct Towel {
-    GLuint VAO, VBO;
-    glm::vec3 position;
-    glm::vec3 angle;
-    glm::vec3 scale;
+    GeometryHandle geometry = INVALID_GEOMETRY;  // The model's mesh in the geometry registry
+    Transform transform;  // Position, angles and scale with cached matrices
     glm::vec4 color;
-    std::vector<unsigned int> indices;
+    bool dynamic = false;  // May move, its shadow is drawn every frame instead of into the cached shadow map
 
     Towel(glm::vec3 position = glm::vec3(0.0f), 
          glm::vec3 scale = glm::vec3(1.0f), 
          glm::vec3 angle = glm::vec3(0.0f, 0.0f, 0.0f), 
          glm::vec4 color = glm::vec4(1.0f), 
          const std::string &objFilePath = nullptr)  // Added texturePath parameter
-         : position(position), angle(angle), scale(scale), color(color) {
+         : transform(position, angle, scale), color(color) {
         loadObjModel(objFilePath);
     }
 
     void loadObjModel(const std::string &objFilePath) {
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(objFilePath, aiProcess_Triangulate | aiProcess_FlipUVs);
-
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-            std::cerr << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        // Welded and cache optimized by the mesh cache, which only runs Assimp when the model changed
+        MeshData mesh;
+        if (!MeshCache::load(objFilePath, mesh)) {
             return;
         }
 
         std::cout << "Loading object: " << objFilePath << std::endl;
-
-        std::vector<float> vertices;
-
-        // Process each mesh
-        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-            aiMesh *mesh = scene->mMeshes[i];
-
-            // Process vertices
-            for (unsigned int j = 0; j < mesh->mNumVertices; j++) {
-                aiVector3D position = mesh->mVertices[j];
-                vertices.push_back(position.x);
-                vertices.push_back(position.y);
-                vertices.push_back(position.z);
-
-                // Process texture coordinates (if available)
-                if (mesh->mTextureCoords[0]) {
-                    aiVector3D texCoord = mesh->mTextureCoords[0][j];
-                    vertices.push_back(texCoord.x);
-                    vertices.push_back(texCoord.y);
-                } else {
-                    vertices.push_back(0.0f); // Default texture coordinates
-                    vertices.push_back(0.0f);
-                }
-            }
-
-            // Process indices
-            for (unsigned int j = 0; j < mesh->mNumFaces; j++) {
-                aiFace face = mesh->mFaces[j];
-                for (unsigned int k = 0; k < face.mNumIndices; k++) {
-                    indices.push_back(face.mIndices[k]);
-                }
-            }
-        }
-
-        // Create and bind VAO/VBO
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        // Vertex positions
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // Texture coordinates
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-
-        // Create element buffer object (EBO)
-        GLuint EBO;
-        glGenBuffers(1, &EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-        glBindVertexArray(0); // Unbind VAO
+        // MeshVertex has the same layout as the primitive shapes: position, normal and texture coordinates
+        geometry = geometryRegistry.acquireIndexed(objFilePath, (const GLfloat*)(mesh.bytes.data() + mesh.vertexOffset()),
+                                                   mesh.vertexCount, (const uint32_t*)mesh.bytes.data(), mesh.indexCount);
     }
 
-    // Load texture
-    GLuint loadTexture(const char* path) const {
-        // Load and create a texture 
-        GLuint texture1;
-        // ====================
-        // Texture 1
-        // ====================
-        glGenTextures(1, &texture1);
-        glBindTexture(GL_TEXTURE_2D, texture1); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
-        // Set our texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set texture wrapping to GL_REPEAT
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set texture filtering
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Load, create texture and generate mipmaps
-        int width, height;
-        unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA);
-        if (image) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            SOIL_free_image_data(image);
-        } else {
-            std::cerr << "Failed to load texture: " << path << std::endl;
+    // World space bounding box for culling
+    AABB bounds() const {
+        if (geometry == INVALID_GEOMETRY) {
+            return AABB();
         }
-
-        glBindTexture(GL_TEXTURE_2D, 0);  // Unbind the texture
-        return texture1;
+        return geometryRegistry.get(geometry).bounds.transformed(transform.world());
     }
 
-    void draw(Shader &shader, const GLint &objectColorLoc, const GLint &modelLoc) const {
-        // Set the brighter to false
-        glUniform1f(glGetUniformLocation(shader.Program, "brighter"), true);
-        glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 0); // disable texture usage
-        // Create a default model to adjust
-        glm::mat4 model = glm::mat4(1.0f);
-        // Set the position for this Trapezoid
-        model = glm::translate(model, position);
-        // Apply rotations in a specific order
-        model = glm::rotate(model, glm::radians(angle.x), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around x-axis
-        model = glm::rotate(model, glm::radians(angle.y), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around y-axis
-        model = glm::rotate(model, glm::radians(angle.z), glm::vec3(0.0f, 0.0f, 1.0f)); // Rotate around z-axis
-        // Set the scale for this Trapezoid
-        model = glm::scale(model, scale);  
-        // Set the model for this Trapezoid
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        // Set the color for this Trapezoid
-        glUniform3fv(objectColorLoc, 1, glm::value_ptr(color));
-     
-        glDrawElements(GL_TRIANGLES, indices.size() * sizeof(unsigned int), GL_UNSIGNED_INT, 0);
+    // Describe how to draw the towel for the render queue
+    DrawItem drawItem(const Shader &shader) const {
+        DrawItem item;
+        item.program = shader.Program;
+        if (geometry != INVALID_GEOMETRY) {
+            const Geometry& shape = geometryRegistry.get(geometry);
+            item.VAO = geometryRegistry.VAO;
+            item.count = shape.indexCount;
+            item.firstIndex = shape.firstIndex;
+            item.baseVertex = shape.baseVertex;
+        }
+        item.model = transform.world();
+        item.normalMatrix = transform.normal();
+        item.color = color;
+        item.brighter = true;
+        item.transparent = color.w < 1.0f;
+        return item;
     }
 };
 
 
+// Cube vertex data (position, normal, texcoord), uploaded once by the geometry registry
+const GLfloat cubeVertices[288] = {
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
+
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+
+    -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f
+};
+
 // Cube structure
 struct Cube {
     // Cube information
-    glm::vec3 position;
+    Transform transform;  // Position, angles and scale with cached matrices
     glm::vec3 rotation;
-    glm::vec3 scale; 
-    glm::vec3 angle;
     glm::vec4 color;
-    GLuint VBO, VAO;
+    GeometryHandle geometry;  // Shared shape from the geometry registry
     GLuint textureID;  // Texture ID for the drawer
-    // Set up vertex data (and buffer(s)) and attribute pointers
-    GLfloat cubeVertices[288] = {
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f
-    };
-
+    GLuint atlasID = 0;  // The texture atlas when the texture was packed into it
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);  // The texture's region of the atlas
+    bool occluder = false;  // Drawn into the occlusion buffer to hide what is behind it
+    bool mirror = false;  // Shows the planar reflection, only drawn that way when translucent since opaque cubes may be batched
+    bool dynamic = false;  // May move, its shadow is drawn every frame instead of into the cached shadow map
+    
     // Cube constructor
     Cube(glm::vec3 position = glm::vec3(0.0f), 
          glm::vec3 rotation = glm::vec3(1.0f, 0.3f, 0.5f), 
@@ -283,179 +274,105 @@ struct Cube {
          glm::vec3 angle = glm::vec3(0.0f, 0.0f, 0.0f), 
          glm::vec4 color = glm::vec4(1.0f), 
          const char* texturePath = nullptr)  // Added texturePath parameter
-         : position(position), rotation(rotation), angle(angle), scale(scale), color(color) {
+         : transform(position, angle, scale), rotation(rotation), color(color) {
         
-        std::pair<GLuint, GLuint> buffers = createVAOAndVBO();
-        VAO = buffers.first;
-        VBO = buffers.second;
+        geometry = geometryRegistry.acquire("cube", cubeVertices, sizeof(cubeVertices));
 
         if (texturePath != nullptr) {
-            std::cout << "Loading texture: " << texturePath << std::endl;
-            textureID = loadTexture(texturePath);  // Load texture if path is provided
+            textureID = textureCache.acquire(texturePath);  // Load texture if path is provided
         } else {
             textureID = -1;
         }
     }
 
-    // Load texture
-    GLuint loadTexture(const char* path) const {
-        // Load and create a texture 
-        GLuint texture1;
-        // ====================
-        // Texture 1
-        // ====================
-        glGenTextures(1, &texture1);
-        glBindTexture(GL_TEXTURE_2D, texture1); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
-        // Set our texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set texture wrapping to GL_REPEAT
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set texture filtering
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Load, create texture and generate mipmaps
-        int width, height;
-        unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA);
-        if (image) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            SOIL_free_image_data(image);
-        } else {
-            std::cerr << "Failed to load texture: " << path << std::endl;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);  // Unbind the texture
-        return texture1;
+    // World space bounding box for culling
+    AABB bounds() const {
+        return geometryRegistry.get(geometry).bounds.transformed(transform.world());
     }
 
-    // Create and return VAO and VBO based on cubeVertices
-    std::pair<GLuint, GLuint> createVAOAndVBO() {
-        GLuint VAO, VBO;
-
-        // Generate and bind VAO and VBO
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-
-        // Bind and upload vertex data to VBO
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-
-        // Bind the VAO and configure the vertex attributes
-        glBindVertexArray(VAO);
-
-        // Position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-        glEnableVertexAttribArray(0);
-        // Normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
-        // TexCoord attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(2);
-
-        // Unbind the VAO
-        glBindVertexArray(0);
-
-        // Return both VAO and VBO as a pair
-        return std::make_pair(VAO, VBO);
-    }
-
-    // Draw the cube
-    void draw(Shader &shader, const GLint &objectColorLoc, const GLint &modelLoc) const {
-        // Set the brighter to false
-        glUniform1f(glGetUniformLocation(shader.Program, "brighter"), false);
-        // Bind the texture for the drawer
-        if (textureID != -1) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glUniform1i(glGetUniformLocation(shader.Program, "texture1"), 0);
-            glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 1); // Enable texture usage
-        } else {
-            glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 0); // disable texture usage
-        }
-
-        // Create a default model to adjust
-        glm::mat4 model = glm::mat4(1.0f);
-        // Set the position for this cube
-        model = glm::translate(model, position);
-        // Apply rotations in a specific order
-        model = glm::rotate(model, glm::radians(angle.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(angle.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(angle.z), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model, scale);
-
-        // Pass the model matrix to the shader
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        // Set the object color
-        glUniform4fv(objectColorLoc, 1, glm::value_ptr(color));
-        glUniform3f(glGetUniformLocation(shader.Program, "objectColor"), color.x, color.y, color.z); // White
-
-        // Draw the cube
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        
-        if (textureID != -1) {
-            // Unbind the texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+    // Describe how to draw the cube for the render queue
+    DrawItem drawItem(const Shader &shader) const {
+        const Geometry& shape = geometryRegistry.get(geometry);
+        DrawItem item;
+        item.program = shader.Program;
+        item.VAO = geometryRegistry.VAO;
+        item.count = shape.indexCount;
+        item.firstIndex = shape.firstIndex;
+        item.baseVertex = shape.baseVertex;
+        // Bind the texture for the drawer, or the atlas it was packed into
+        if (atlasID != 0) {
+            item.texture = atlasID;
+            item.uvRect = uvRect;
+        } else if (textureID != -1) {
+            item.texture = textureID;
         }
+        item.model = transform.world();
+        item.normalMatrix = transform.normal();
+        item.color = color;
+        item.brighter = false;
+        item.mirror = mirror;
+        item.transparent = color.w < 1.0f;
+        return item;
     }
 };
 
+// wiiGame vertex data, only the front face is texture mapped
+const GLfloat wiiGameVertices[288] = {
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
+
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+
+    -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f
+};
+
 // wiiGame structure
 struct wiiGame {
     // Cube information
-    glm::vec3 position;
+    Transform transform;  // Position, angles and scale with cached matrices
     glm::vec3 rotation;
-    glm::vec3 scale; 
-    glm::vec3 angle;
     glm::vec4 color;
-    GLuint VBO, VAO;
+    GeometryHandle geometry;  // Shared shape from the geometry registry
     GLuint textureID;  // Texture ID for the drawer
-    // Set up vertex data (and buffer(s)) and attribute pointers
-    GLfloat wiiGameVertices[288] = {
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f
-    };
-
+    GLuint atlasID = 0;  // The texture atlas when the texture was packed into it
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);  // The texture's region of the atlas
+    bool dynamic = false;  // May move, its shadow is drawn every frame instead of into the cached shadow map
+    
     // wiiGame constructor
     wiiGame(glm::vec3 position = glm::vec3(0.0f), 
          glm::vec3 rotation = glm::vec3(1.0f, 0.3f, 0.5f), 
@@ -463,417 +380,379 @@ struct wiiGame {
          glm::vec3 angle = glm::vec3(0.0f, 0.0f, 0.0f), 
          glm::vec4 color = glm::vec4(1.0f), 
          const char* texturePath = nullptr)  // Added texturePath parameter
-         : position(position), rotation(rotation), angle(angle), scale(scale), color(color) {
+         : transform(position, angle, scale), rotation(rotation), color(color) {
         
-        std::pair<GLuint, GLuint> buffers = createVAOAndVBO();
-        VAO = buffers.first;
-        VBO = buffers.second;
+        geometry = geometryRegistry.acquire("wiiGame", wiiGameVertices, sizeof(wiiGameVertices));
 
         if (texturePath != nullptr) {
-            std::cout << "Loading texture: " << texturePath << std::endl;
-            textureID = loadTexture(texturePath);  // Load texture if path is provided
+            textureID = textureCache.acquire(texturePath);  // Load texture if path is provided
         } else {
             textureID = -1;
         }
     }
 
-    // Load texture
-    GLuint loadTexture(const char* path) const {
-        // Load and create a texture 
-        GLuint texture1;
-        // ====================
-        // Texture 1
-        // ====================
-        glGenTextures(1, &texture1);
-        glBindTexture(GL_TEXTURE_2D, texture1); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
-        // Set our texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set texture wrapping to GL_REPEAT
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set texture filtering
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Load, create texture and generate mipmaps
-        int width, height;
-        unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA);
-        if (image) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            SOIL_free_image_data(image);
-        } else {
-            std::cerr << "Failed to load texture: " << path << std::endl;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);  // Unbind the texture
-        return texture1;
-    }
-
-    // Create and return VAO and VBO based on cubeVertices
-    std::pair<GLuint, GLuint> createVAOAndVBO() {
-        GLuint VAO, VBO;
-
-        // Generate and bind VAO and VBO
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-
-        // Bind and upload vertex data to VBO
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(wiiGameVertices), wiiGameVertices, GL_STATIC_DRAW);
-
-        // Bind the VAO and configure the vertex attributes
-        glBindVertexArray(VAO);
-
-        // Position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-        glEnableVertexAttribArray(0);
-        // Normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
-        // TexCoord attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(2);
-
-        // Unbind the VAO
-        glBindVertexArray(0);
-
-        // Return both VAO and VBO as a pair
-        return std::make_pair(VAO, VBO);
+    // World space bounding box for culling
+    AABB bounds() const {
+        return geometryRegistry.get(geometry).bounds.transformed(transform.world());
     }
 
-    // Draw the wiiGame
-    void draw(Shader &shader, const GLint &objectColorLoc, const GLint &modelLoc) const {
-        // Set the brighter to false
-        glUniform1f(glGetUniformLocation(shader.Program, "brighter"), true);
-        // Bind the texture for the drawer
-        if (textureID != -1) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glUniform1i(glGetUniformLocation(shader.Program, "texture1"), 0);
-            glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 1); // Enable texture usage
-        } else {
-            glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 0); // disable texture usage
-        }
-
-        // Create a default model to adjust
-        glm::mat4 model = glm::mat4(1.0f);
-        // Set the position for this cube
-        model = glm::translate(model, position);
-        // Apply rotations in a specific order
-        model = glm::rotate(model, glm::radians(angle.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(angle.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(angle.z), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model, scale);
-
-        // Pass the model matrix to the shader
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        // Set the object color
-        glUniform4fv(objectColorLoc, 1, glm::value_ptr(color));
-        glUniform3f(glGetUniformLocation(shader.Program, "objectColor"), color.x, color.y, color.z); // White
-
-        // Draw the wiiGame
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        
-        if (textureID != -1) {
-            // Unbind the texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+    // Describe how to draw the wiiGame for the render queue
+    DrawItem drawItem(const Shader &shader) const {
+        const Geometry& shape = geometryRegistry.get(geometry);
+        DrawItem item;
+        item.program = shader.Program;
+        item.VAO = geometryRegistry.VAO;
+        item.count = shape.indexCount;
+        item.firstIndex = shape.firstIndex;
+        item.baseVertex = shape.baseVertex;
+        // Bind the texture for the drawer, or the atlas it was packed into
+        if (atlasID != 0) {
+            item.texture = atlasID;
+            item.uvRect = uvRect;
+        } else if (textureID != -1) {
+            item.texture = textureID;
         }
+        item.model = transform.world();
+        item.normalMatrix = transform.normal();
+        item.color = color;
+        item.brighter = true;
+        item.transparent = color.w < 1.0f;
+        return item;
     }
 };
 
+// Pyramid vertex data (position, normal, texcoord)
+const GLfloat pyramidVertices[144] = {
+    // Base square (two triangles)
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f, 0.0f, 0.0f, 0.0f, // Bottom left
+     0.5f, -0.5f, -0.5f,  0.0f, -1.0f, 0.0f, 1.0f, 0.0f, // Bottom right
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f, 0.0f, 1.0f, 1.0f, // Top right
+     -0.5f, -0.5f, -0.5f,  0.0f, -1.0f, 0.0f, 1.0f, 1.0f, // Bottom left
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f, 0.0f, 0.0f, 1.0f, // Top right
+    -0.5f, -0.5f,  0.5f,  0.0f, -1.0f, 0.0f, 0.0f, 0.0f, // Top left
+
+    // Side triangles (4 faces)
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.447f,  0.894f, 0.0f, 0.0f, // Base bottom left
+     0.5f, -0.5f, -0.5f,  0.0f,  0.447f,  0.894f, 1.0f, 0.0f, // Base bottom right
+     0.0f,  0.5f,  0.0f,  0.0f,  0.447f,  0.894f, 1.0f, 1.0f, // Apex
+
+     0.5f, -0.5f, -0.5f,  0.894f,  0.447f,  0.0f, 1.0f, 1.0f, // Base bottom right
+     0.5f, -0.5f,  0.5f,  0.894f,  0.447f,  0.0f, 0.0f, 1.0f, // Base top right
+     0.0f,  0.5f,  0.0f,  0.894f,  0.447f,  0.0f, 0.0f, 0.0f, // Apex
+
+     0.5f, -0.5f,  0.5f,  0.0f,  0.447f, -0.894f, 0.0f, 0.0f, // Base top right
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.447f, -0.894f, 1.0f, 0.0f, // Base top left
+     0.0f,  0.5f,  0.0f,  0.0f,  0.447f, -0.894f, 1.0f, 1.0f, // Apex
+
+    -0.5f, -0.5f,  0.5f, -0.894f,  0.447f,  0.0f, 1.0f, 1.0f, // Base top left
+    -0.5f, -0.5f, -0.5f, -0.894f,  0.447f,  0.0f, 0.0f, 1.0f, // Base bottom left
+     0.0f,  0.5f,  0.0f, -0.894f,  0.447f,  0.0f, 0.0f, 0.0f, // Apex
+};
+
 // Pyramid structure
 struct Pyramid {
     // Pyramid information
-    glm::vec3 position;
+    Transform transform;  // Position, angles and scale with cached matrices
     glm::vec3 rotation;
-    glm::vec3 scale; 
-    glm::vec3 angle;
     glm::vec4 color;
-    GLuint VBO, VAO;
+    GeometryHandle geometry;  // Shared shape from the geometry registry
+    bool dynamic = false;  // May move, its shadow is drawn every frame instead of into the cached shadow map
+    
     
-    // Set up vertex data (and buffer(s)) and attribute pointers
-    GLfloat pyramidVertices[144] = {
-        // Base square (two triangles)
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f, 0.0f, 0.0f, 0.0f, // Bottom left
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f, 0.0f, 1.0f, 0.0f, // Bottom right
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f, 0.0f, 1.0f, 1.0f, // Top right
-         -0.5f, -0.5f, -0.5f,  0.0f, -1.0f, 0.0f, 1.0f, 1.0f, // Bottom left
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f, 0.0f, 0.0f, 1.0f, // Top right
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f, 0.0f, 0.0f, 0.0f, // Top left
-
-        // Side triangles (4 faces)
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.447f,  0.894f, 0.0f, 0.0f, // Base bottom left
-         0.5f, -0.5f, -0.5f,  0.0f,  0.447f,  0.894f, 1.0f, 0.0f, // Base bottom right
-         0.0f,  0.5f,  0.0f,  0.0f,  0.447f,  0.894f, 1.0f, 1.0f, // Apex
-
-         0.5f, -0.5f, -0.5f,  0.894f,  0.447f,  0.0f, 1.0f, 1.0f, // Base bottom right
-         0.5f, -0.5f,  0.5f,  0.894f,  0.447f,  0.0f, 0.0f, 1.0f, // Base top right
-         0.0f,  0.5f,  0.0f,  0.894f,  0.447f,  0.0f, 0.0f, 0.0f, // Apex
-
-         0.5f, -0.5f,  0.5f,  0.0f,  0.447f, -0.894f, 0.0f, 0.0f, // Base top right
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.447f, -0.894f, 1.0f, 0.0f, // Base top left
-         0.0f,  0.5f,  0.0f,  0.0f,  0.447f, -0.894f, 1.0f, 1.0f, // Apex
-
-        -0.5f, -0.5f,  0.5f, -0.894f,  0.447f,  0.0f, 1.0f, 1.0f, // Base top left
-        -0.5f, -0.5f, -0.5f, -0.894f,  0.447f,  0.0f, 0.0f, 1.0f, // Base bottom left
-         0.0f,  0.5f,  0.0f, -0.894f,  0.447f,  0.0f, 0.0f, 0.0f, // Apex
-    };
-
     // Pyramid constructor
     Pyramid(glm::vec3 position = glm::vec3(0.0f), glm::vec3 rotation = glm::vec3(0.1f, 0.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f), glm::vec3 angle = glm::vec3(0.0f), glm::vec4 color = glm::vec4(1.0f))
-         : position(position), rotation(rotation), angle(angle), scale(scale), color(color) {
-            std::pair<GLuint, GLuint> buffers = createVAOAndVBO();
-            VAO = buffers.first;
-            VBO = buffers.second;
+         : transform(position, angle, scale), rotation(rotation), color(color) {
+            geometry = geometryRegistry.acquire("pyramid", pyramidVertices, sizeof(pyramidVertices));
         }
 
-    // Create and return VAO and VBO based on pyramidVertices
-    std::pair<GLuint, GLuint> createVAOAndVBO() {
-        GLuint VAO, VBO;
-
-        // Generate and bind VAO and VBO
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-
-        // Bind and upload vertex data to VBO
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(pyramidVertices), pyramidVertices, GL_STATIC_DRAW);
-
-        // Bind the VAO and configure the vertex attributes
-        glBindVertexArray(VAO);
-
-        // Position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-        glEnableVertexAttribArray(0);
-        // Normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
-        // TexCoord attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(2);
-
-        // Unbind the VAO
-        glBindVertexArray(0);
-
-        // Return both VAO and VBO as a pair
-        return std::make_pair(VAO, VBO);
+    // World space bounding box for culling
+    AABB bounds() const {
+        return geometryRegistry.get(geometry).bounds.transformed(transform.world());
     }
 
-    // Load texture
-    GLuint loadTexture(const char* path) const {
-        // Load and create a texture 
-        GLuint texture1;
-        // ====================
-        // Texture 1
-        // ====================
-        glGenTextures(1, &texture1);
-        glBindTexture(GL_TEXTURE_2D, texture1); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
-        // Set our texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set texture wrapping to GL_REPEAT
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set texture filtering
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Load, create texture and generate mipmaps
-        int width, height;
-        unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA);
-        if (image) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            SOIL_free_image_data(image);
-        } else {
-            std::cerr << "Failed to load texture: " << path << std::endl;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);  // Unbind the texture
-        return texture1;
+    // Describe how to draw the pyramid for the render queue
+    DrawItem drawItem(const Shader &shader) const {
+        const Geometry& shape = geometryRegistry.get(geometry);
+        DrawItem item;
+        item.program = shader.Program;
+        item.VAO = geometryRegistry.VAO;
+        item.count = shape.indexCount;
+        item.firstIndex = shape.firstIndex;
+        item.baseVertex = shape.baseVertex;
+        item.model = transform.world();
+        item.normalMatrix = transform.normal();
+        item.color = color;
+        item.brighter = false;
+        item.transparent = color.w < 1.0f;
+        return item;
     }
+};
 
-    // Draw the pyramid
-    void draw(Shader &shader, const GLint &objectColorLoc, const GLint &modelLoc) const {
-        // Set the brighter to false
-        glUniform1f(glGetUniformLocation(shader.Program, "brighter"), false);
-        glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 0); // disable texture usage
-        // Create a default model to adjust
-        glm::mat4 model = glm::mat4(1.0f);
-        // Set the position for this pyramid
-        model = glm::translate(model, position);
-        // Set the rotation for this pyramid
-        model = glm::rotate(model, glm::radians(angle.x), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around x-axis
-        model = glm::rotate(model, glm::radians(angle.y), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around y-axis
-        model = glm::rotate(model, glm::radians(angle.z), glm::vec3(0.0f, 0.0f, 1.0f)); // Rotate around z-axis
-        // Set the scale for this pyramid
-        model = glm::scale(model, scale);  
-        // Set the model for this pyramid
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        // Set the color for this pyramid
-        glUniform3fv(objectColorLoc, 1, glm::value_ptr(color));
-        
-        // Draw the pyramid using triangles
-        glDrawArrays(GL_TRIANGLES, 0, 18); // 6 triangles for the pyramid (1 base + 4 sides)
-    }
+// Trapezoid vertex data (position, normal, texcoord)
+const GLfloat trapezoidVertices[336] = {
+    // Back face
+    -2.0f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
+    0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f,
+    0.25f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
+    0.25f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
+    -2.0f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f,
+    -2.0f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
+
+    // Front face (smaller base)
+    -2.0f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+    0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f,
+    0.25f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
+    0.25f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
+    -2.0f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f,
+    -2.0f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
+
+    // Left face (vertical)
+    -2.0f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+    -2.0f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
+    -2.0f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    -2.0f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    -2.0f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
+    -2.0f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+
+    // Right face
+    0.25f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+    0.25f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
+    0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
+    0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
+    0.25f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
+
+    // Bottom face
+    -2.0f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+    0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f,
+    0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
+    0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
+    -2.0f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f,
+    -2.0f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
+
+    // Top face (narrower)
+    -2.0f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+     0.25f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f,
+     0.25f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
+     0.25f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
+    -2.0f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f,
+    -2.0f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f
 };
 
 // Trapezoid structure
 struct Trapezoid {
     // Trapezoid information
-    glm::vec3 position;
+    Transform transform;  // Position, angles and scale with cached matrices
     glm::vec3 rotation;
-    glm::vec3 scale; 
-    glm::vec3 angle;
     glm::vec4 color;
-    GLuint VBO, VAO;
-    // Set up vertex data (and buffer(s)) and attribute pointers
-    GLfloat trapezoidVertices[336] = {
-        // Back face
-        -2.0f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f,
-        0.25f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
-        0.25f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f,
-        -2.0f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f,
-        -2.0f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f,
-
-        // Front face (smaller base)
-        -2.0f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f,
-        0.25f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
-        0.25f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f,
-        -2.0f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f,
-        -2.0f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-
-        // Left face (vertical)
-        -2.0f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-        -2.0f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-        -2.0f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        -2.0f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        -2.0f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
-        -2.0f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-
-        // Right face
-        0.25f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-        0.25f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f,
-        0.25f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-
-        // Bottom face
-        -2.0f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f,
-        -2.0f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f,
-        -2.0f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-
-        // Top face (narrower)
-        -2.0f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-         0.25f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f,
-         0.25f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
-         0.25f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f,
-        -2.0f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f,
-        -2.0f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f
-    };
-
+    GeometryHandle geometry;  // Shared shape from the geometry registry
+    bool dynamic = false;  // May move, its shadow is drawn every frame instead of into the cached shadow map
+    
     // Trapezoid constructor
     Trapezoid(glm::vec3 position = glm::vec3(0.0f), glm::vec3 rotation = glm::vec3(1.0f, 0.3f, 0.5f), glm::vec3 scale = glm::vec3(1.0f), glm::vec3 angle = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4 color = glm::vec4(1.0f))
-         : position(position), rotation(rotation), angle(angle), scale(scale), color(color) {
-            std::pair<GLuint, GLuint> buffers = createVAOAndVBO();
-            VAO = buffers.first;
-            VBO = buffers.second;
+         : transform(position, angle, scale), rotation(rotation), color(color) {
+            geometry = geometryRegistry.acquire("trapezoid", trapezoidVertices, sizeof(trapezoidVertices));
          }
 
-    // Load texture
-    GLuint loadTexture(const char* path) const {
-        // Load and create a texture 
-        GLuint texture1;
-        // ====================
-        // Texture 1
-        // ====================
-        glGenTextures(1, &texture1);
-        glBindTexture(GL_TEXTURE_2D, texture1); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
-        // Set our texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set texture wrapping to GL_REPEAT
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set texture filtering
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Load, create texture and generate mipmaps
-        int width, height;
-        unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA);
-        if (image) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            SOIL_free_image_data(image);
-        } else {
-            std::cerr << "Failed to load texture: " << path << std::endl;
+    // World space bounding box for culling
+    AABB bounds() const {
+        return geometryRegistry.get(geometry).bounds.transformed(transform.world());
+    }
+
+    // Describe how to draw the Trapezoid for the render queue
+    DrawItem drawItem(const Shader &shader) const {
+        const Geometry& shape = geometryRegistry.get(geometry);
+        DrawItem item;
+        item.program = shader.Program;
+        item.VAO = geometryRegistry.VAO;
+        item.count = shape.indexCount;
+        item.firstIndex = shape.firstIndex;
+        item.baseVertex = shape.baseVertex;
+        item.model = transform.world();
+        item.normalMatrix = transform.normal();
+        item.color = color;
+        item.brighter = false;
+        item.transparent = color.w < 1.0f;
+        return item;
+    }
+};
+
+// Points the objects whose texture was packed into the atlas at their region of it
+template <typename T>
+void useAtlas(std::vector<T>& objects)
+{
+    for (auto& object : objects) {
+        if (object.textureID != (GLuint)-1) {
+            object.atlasID = textureAtlas.find(textureCache.pathOf(object.textureID), object.uvRect);
         }
+    }
+}
 
-        glBindTexture(GL_TEXTURE_2D, 0);  // Unbind the texture
-        return texture1;
+// Appends the world space bounds of the objects and returns where they start
+template <typename T>
+size_t addBounds(std::vector<AABB>& bounds, const std::vector<T>& objects)
+{
+    size_t first = bounds.size();
+    for (const auto& object : objects) {
+        bounds.push_back(object.bounds());
     }
+    return first;
+}
 
-    // Create and return VAO and VBO based on pyramidVertices
-    std::pair<GLuint, GLuint> createVAOAndVBO() {
-        GLuint VAO, VBO;
+// Builds the draw items of a group's objects on the job system. visible, drawItems and drawn are indexed like the
+// scene's bounds and the group starts at first. drawn[i] marks the items to submit: the visible objects, leaving
+// out the opaque ones an instanced batch draws. The vectors and objects must live until the group is waited on.
+template <typename T>
+void prepareGroup(JobGroup& group, const Shader& shader, const std::vector<T>& objects, size_t first, bool batched,
+                  const std::vector<char>& visible, std::vector<DrawItem>& drawItems, std::vector<char>& drawn, const char* name)
+{
+    jobs.parallelFor(group, objects.size(), JOB_GRAIN, [&, first, batched, name](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            bool draw = visible[first + i] && !(batched && objects[i].color.w >= 1.0f);
+            drawn[first + i] = draw;
+            if (draw) {
+                drawItems[first + i] = objects[i].drawItem(shader);
+                drawItems[first + i].group = name;
+            }
+        }
+    });
+}
 
-        // Generate and bind VAO and VBO
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
+// Queues the prepared draw items of count objects starting at first. The draws are profiled under name.
+void submitPrepared(RenderQueue& queue, const std::vector<DrawItem>& drawItems, const std::vector<char>& drawn,
+                    size_t first, size_t count, const char* name)
+{
+    ProfileScope scope(profiler, name);
+    for (size_t i = first; i < first + count; i++) {
+        if (drawn[i]) {
+            queue.submit(drawItems[i]);
+        }
+    }
+}
 
-        // Bind and upload vertex data to VBO
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(trapezoidVertices), trapezoidVertices, GL_STATIC_DRAW);
+// Queues a group's instanced batch with the culled instances dropped, then its prepared transparent objects
+template <typename T>
+void submitGroup(RenderQueue& queue, const Shader& shader, const std::vector<T>& objects, InstancedGroup& batch,
+                 const std::vector<char>& visible, const std::vector<DrawItem>& drawItems, const std::vector<char>& drawn,
+                 size_t first, const char* name)
+{
+    if (instancedRendering) {
+        ProfileScope scope(profiler, name);
+        // Pick up any transforms that moved since the batch was packed, then drop the culled instances
+        batch.refresh(objects, textureCache);
+        batch.cull(visible.data() + first);
+        if (batch.instanceCount > 0) {
+            DrawItem item = batch.drawItem(shader);
+            item.group = name;
+            queue.submit(item);
+        }
+    }
+    submitPrepared(queue, drawItems, drawn, first, objects.size(), name);
+}
 
-        // Bind the VAO and configure the vertex attributes
-        glBindVertexArray(VAO);
+// Queues one shadow caster. Casters only write depth, so the texture is dropped and they all share a multi-draw.
+void submitCaster(RenderQueue& queue, DrawItem item, const char* name)
+{
+    item.texture = 0;
+    item.textureTarget = GL_TEXTURE_2D;
+    item.group = name;
+    queue.submit(item);
+}
 
-        // Position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-        glEnableVertexAttribArray(0);
-        // Normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
-        // TexCoord attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(2);
+// Queues the opaque objects of a group that cast shadows, the dynamic ones or the static ones. The opaque
+// parts of a baked group cast their shadows through the baked meshes instead, which are always static.
+template <typename T>
+void submitCasters(RenderQueue& queue, const Shader& shader, const std::vector<T>& objects, bool baked, bool dynamic)
+{
+    if (baked) {
+        return;
+    }
+    for (const auto& object : objects) {
+        if (object.color.w >= 1.0f && object.dynamic == dynamic) {
+            submitCaster(queue, object.drawItem(shader), dynamic ? "Dynamic shadows" : "Shadow map");
+        }
+    }
+}
 
-        // Unbind the VAO
-        glBindVertexArray(0);
+// Adds up the transform versions of a group's static objects, the sum changes whenever one of them moves
+template <typename T>
+unsigned long casterVersion(const std::vector<T>& objects)
+{
+    unsigned long version = 0;
+    for (const auto& object : objects) {
+        if (!object.dynamic) {
+            version += object.transform.version();
+        }
+    }
+    return version;
+}
 
-        // Return both VAO and VBO as a pair
-        return std::make_pair(VAO, VBO);
+// Adds up the transform versions of all of a group's objects, the sum changes whenever one of them moves
+template <typename T>
+unsigned long sceneVersion(const std::vector<T>& objects)
+{
+    unsigned long version = 0;
+    for (const auto& object : objects) {
+        version += object.transform.version();
     }
+    return version;
+}
 
-    // Draw the Trapezoid
-    void draw(Shader &shader, const GLint &objectColorLoc, const GLint &modelLoc) const{
-        // Set the brighter to false
-        glUniform1f(glGetUniformLocation(shader.Program, "brighter"), false);
-        glUniform1i(glGetUniformLocation(shader.Program, "useTexture"), 0); // disable texture usage
-        // Create a default model to adjust
-        glm::mat4 model = glm::mat4(1.0f);
-        // Set the position for this Trapezoid
-        model = glm::translate(model, position);
-        // Apply rotations in a specific order
-        model = glm::rotate(model, glm::radians(angle.x), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around x-axis
-        model = glm::rotate(model, glm::radians(angle.y), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around y-axis
-        model = glm::rotate(model, glm::radians(angle.z), glm::vec3(0.0f, 0.0f, 1.0f)); // Rotate around z-axis
-        // Set the scale for this Trapezoid
-        model = glm::scale(model, scale);  
-        // Set the model for this Trapezoid
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        // Set the color for this Trapezoid
-        glUniform3fv(objectColorLoc, 1, glm::value_ptr(color));
-        
-        // Draw the Trapezoid using triangles
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+// Adds the world space bounds of a group's opaque dynamic objects to box
+template <typename T>
+void addDynamicBounds(AABB& box, const std::vector<T>& objects, bool baked)
+{
+    for (const auto& object : objects) {
+        if (!baked && object.dynamic && object.color.w >= 1.0f) {
+            box.add(object.bounds());
+        }
     }
-};
+}
 
 // Main function
-int main()
+int main(int argc, char* argv[])
 {
-    // Initialize Window
-    GLFWwindow* window = windowInit();
+    // Parse the command line
+    for (int arg = 1; arg < argc; arg++) {
+        std::string option = argv[arg];
+        if (option == "--benchmark" && arg + 1 < argc) {
+            benchmarkFrames = std::atoi(argv[++arg]);
+        } else if (option == "--json" && arg + 1 < argc) {
+            benchmarkOutput = argv[++arg];
+        } else if (option == "--scene" && arg + 1 < argc) {
+            scenePath = argv[++arg];
+        } else if (option == "--compress-textures") {
+            textureCache.disk.compress = true;
+        } else if (option == "--no-occlusion") {
+            occlusionCulling = false;
+        } else if (option == "--trace" && arg + 1 < argc) {
+            tracePath = argv[++arg];
+        } else if (option == "--lights" && arg + 1 < argc) {
+            extraLights = std::atoi(argv[++arg]);
+        } else if (option == "--reflection-scale" && arg + 1 < argc) {
+            reflection.scale = (float)std::atof(argv[++arg]);
+        } else if (option == "--reflection-rate" && arg + 1 < argc) {
+            reflection.rate = (float)std::atof(argv[++arg]);
+        } else if (option == "--frame-budget" && arg + 1 < argc) {
+            dynamicResolution.budget = (float)std::atof(argv[++arg]);
+        } else if (option == "--min-scale" && arg + 1 < argc) {
+            dynamicResolution.minScale = (float)std::atof(argv[++arg]);
+        } else if (option == "--on-demand") {
+            redrawTracker.enabled = true;
+        } else if (option == "--bake" && arg + 1 < argc) {
+            bakedGroups.push_back(argv[++arg]);
+        }
+    }
+
+    // Initialize Window, or an offscreen context when benchmarking
+    GLFWwindow* window = nullptr;
+    if (benchmarkFrames > 0) {
+        if (!headlessInit()) {
+            return 1;
+        }
+    } else {
+        window = windowInit();
+    }
 
     // Set the desired mouse sensitivity
     //camera.setMouseSensitivity(0.1f);
@@ -882,762 +761,557 @@ int main()
 
     // Build and compile our shader program
     Shader ourShader("Project5.vs", "Project5.frag");
+    // 2D textures are sampled from texture unit 0 and the texture array of instanced groups from unit 1
+    ourShader.Use();
+    ourShader.setInt("texture1", 0);
+    ourShader.setInt("textureArray", 1);
+    // Lights and their clusters are read from texture buffers
+    ourShader.setInt("lightData", ClusteredLights::LIGHT_UNIT);
+    ourShader.setInt("clusterGrid", ClusteredLights::GRID_UNIT);
+    ourShader.setInt("lightIndices", ClusteredLights::INDEX_UNIT);
+    clusteredLights.setProjection(glm::radians(camera.Zoom), (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f, WIDTH, HEIGHT);
+    ourShader.setVec4("clusterParams", clusteredLights.params());
+    // The scene light's shadow map is sampled from its own unit
+    ourShader.setInt("shadowMap", ShadowMap::UNIT);
+    // The planar reflection is looked up by window position
+    ourShader.setInt("reflectionMap", PlanarReflection::UNIT);
+    ourShader.setVec2("viewportSize", glm::vec2(WIDTH, HEIGHT));
+    // Per-draw data comes from the render queue's draw ring
+    ourShader.bindUniformBlock("DrawData", DrawRing::BINDING);
+
+    // Depth only program the shadow casters are drawn with
+    Shader shadowShader("Shadow.vs", "Shadow.frag");
+    shadowShader.bindUniformBlock("DrawData", DrawRing::BINDING);
+
+    // Build the scene from the baked scene file ---------------------------------
+    std::vector<Cube> room, tvStandParts, sensorBar, wiiDetails, TelevisionParts;
+    std::vector<wiiGame> wiiGames;
+    std::vector<Trapezoid> wii;
+    std::vector<Pyramid> tvStands;
+    std::vector<Towel> towels;
+    // Cubes are sorted into groups by name, the other shapes each have one group
+    std::map<std::string, std::vector<Cube>*> cubeGroups = {
+        {"room", &room},
+        {"tvStand", &tvStandParts},
+        {"sensorBar", &sensorBar},
+        {"wiiDetails", &wiiDetails},
+        {"television", &TelevisionParts}
+    };
 
-    // Object Color and Model Location
-    GLint objectColorLoc, modelLoc;
-
-    // Create the background ------------------------------------------------------
-    Cube Wall(
-        glm::vec3(0.0f, 1.0f, -0.55f), 
-        glm::vec3(1.0f, 0.3f, 0.5f), 
-        glm::vec3(3.0f, 2.0f, 0.2f), 
-        glm::vec3(0.0f), 
-        glm::vec4(0.876f, 0.848f, 0.784f, 1.0f),
-        "./Textures/wall.jpg"
-    );
-
-    Cube Trim(
-        glm::vec3(0.0f, 0.0f, -0.549f), 
-        glm::vec3(1.0f, 0.3f, 0.5f), 
-        glm::vec3(3.0f, 0.3f, 0.2f), 
-        glm::vec3(0.0f), 
-        glm::vec4(0.24f, 0.236f, 0.228f, 1.0f)
-    );
-
-    Cube Floor(
-        glm::vec3(0.0f, -0.1f, 0.0f), 
-        glm::vec3(1.0f, 0.3f, 0.5f), 
-        glm::vec3(3.0f, 2.0f, 0.2f), 
-        glm::vec3(90.0f, 0.0f, 0.0f), 
-        glm::vec4(0.464f, 0.372f, 0.3f, 1.0f),
-        "./Textures/floor.jpg"
-    );
-    // ----------------------------------------------------------------------------
+    // Textures to pack into the atlas, in the order the scene names them
+    std::vector<std::string> atlasPaths;
 
-    // Create TV Stand Parts ------------------------------------------------------
-    std::vector<Cube> tvStandParts;
-
-    // 1. Drawer Section
-    Cube drawer(
-        glm::vec3(0.0f, inchesToMeters(4.0f + 12.0f / 2), 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation (Uniform)
-        glm::vec3(feetToMeters(4.81f), inchesToMeters(10.0f), feetToMeters(2.0f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(1.0f),                    // Color (wooden)
-        "./Textures/wood_grain_rot.jpg"
-    );
-    tvStandParts.push_back(drawer);
-
-    Cube drawerBottom(
-        glm::vec3(0.0f, inchesToMeters(9.0f / 2), 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.81f), inchesToMeters(1.0f), feetToMeters(2.0f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
-    );
-    tvStandParts.push_back(drawerBottom);
-
-    Cube drawerSide(
-        glm::vec3(0.0f, inchesToMeters(9.5f + 12.0f / 2), 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.81f), inchesToMeters(1.0f), feetToMeters(2.0f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
-        "./Textures/side.jpg"
-    );
-    tvStandParts.push_back(drawerSide);
-
-    Cube drawerEdge(
-        glm::vec3(-0.7f, inchesToMeters(9.521f + 12.0f / 2), 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.805f)/40, inchesToMeters(0.99f), feetToMeters(1.99f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
-        "./Textures/side.jpg"
-    );
-    tvStandParts.push_back(drawerEdge);
-
-    Cube drawerReflection(
-        glm::vec3(-0.64f, inchesToMeters(9.521f + 12.0f / 2), 0.0007f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.805f)/40, inchesToMeters(0.99f), feetToMeters(2.05f)), // Scale
-        glm::vec3(0.0f, 15.0f, 0.0f),                                                    // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 0.6f),
-        "./Textures/reflect.jpg"
-    );
-    tvStandParts.push_back(drawerReflection);
-    Cube drawerReflection2(
-        glm::vec3(0.0f, inchesToMeters(9.521f + 12.0f / 2), 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.805f)/20, inchesToMeters(0.99f), feetToMeters(1.99f)), // Scale
-        glm::vec3(0.0f, 0.0f, 0.0f),                                                    // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 0.6f),
-        "./Textures/reflect.jpg"
-    );
-    tvStandParts.push_back(drawerReflection2);
-
-    Cube drawerTop(
-        glm::vec3(0.0f, inchesToMeters(9.52f + 12.0f / 2), 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.805f), inchesToMeters(0.99f), feetToMeters(1.99f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 0.9f),
-        "./Textures/base.jpg"
-    );
-    tvStandParts.push_back(drawerTop);
-
-    // 1. Drawer Section
-    Cube innerDrawer(
-        glm::vec3(0.0f, inchesToMeters(4.0f + 12.0f / 2), 0.05f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(4.0f), inchesToMeters(10.0f), feetToMeters(1.8f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.288f, 0.188f, 0.16f, 1.0f),                    // Color (wooden)
-        "./Textures/wood_grain.jpg"
-    );
-    tvStandParts.push_back(innerDrawer);
-
-    // 1. Drawer Section
-    Cube handle(
-        glm::vec3(0.0f, inchesToMeters(4.0f + 12.0f / 2), 0.37f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.8f), inchesToMeters(1.0f), feetToMeters(0.1f)), // Scale
-        glm::vec3(0.0f),                                                     // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),                       // Color (Black)
-        "./Textures/handle.jpg"
-    );
-    tvStandParts.push_back(handle);
-
-    Cube handleLeft(
-        glm::vec3(-0.11f, inchesToMeters(4.0f + 12.0f / 2), 0.3f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(inchesToMeters(1.0f), inchesToMeters(1.0f), feetToMeters(0.4f)), // Scale
-        glm::vec3(0.0f),                                          // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),                       // Color (Black)
-        "./Textures/innerHandle.jpg"                     
-    );
-    tvStandParts.push_back(handleLeft);
-
-    Cube handleRight(
-        glm::vec3(0.11f, inchesToMeters(4.0f + 12.0f / 2), 0.3f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(inchesToMeters(1.0f), inchesToMeters(1.0f), feetToMeters(0.4f)), // Scale
-        glm::vec3(0.0f),                                          // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),                       // Color (Black)
-        "./Textures/innerHandle.jpg"
-    );
-    tvStandParts.push_back(handleRight);
-
-    float xPos = 2.2f;
-    float zPos = 0.95f;
-    // Feet
-    std::vector<glm::vec3> feetPositions = {
-        glm::vec3(feetToMeters(-xPos), inchesToMeters(4.0f / 2), feetToMeters(-zPos + 0.05f)),
-        glm::vec3(feetToMeters(xPos), inchesToMeters(4.0f / 2), feetToMeters(-zPos + 0.05f)),
-        glm::vec3(feetToMeters(-xPos), inchesToMeters(4.0f / 2), feetToMeters(zPos - 0.05f)),
-        glm::vec3(feetToMeters(xPos), inchesToMeters(4.0f / 2), feetToMeters(zPos - 0.05f))
-    };
-    for (auto& pos : feetPositions) {
-        Cube foot(
-            pos,
-            glm::vec3(1.0f, 0.3f, 0.5f),
-            glm::vec3(inchesToMeters(5.0f), inchesToMeters(4.0f), inchesToMeters(1.5f)),
-            glm::vec3(0.0f), 
-            glm::vec4(0.228f, 0.152f, 0.128f, 1.0f),
-            "./Textures/wood_grain_rot.jpg"     
-        );
-        tvStandParts.push_back(foot);
+    SceneFile scene;
+    if (!scene.openCompiled(scenePath)) {
+        std::cerr << "ERROR::SCENE::NOT_LOADED " << scenePath << std::endl;
+        return 1;
     }
+    for (size_t index = 0; index < scene.count(); index++) {
+        const SceneRecord& record = scene[index];
+        glm::vec3 position(record.position[0], record.position[1], record.position[2]);
+        glm::vec3 scale(record.scale[0], record.scale[1], record.scale[2]);
+        glm::vec3 angle(record.angle[0], record.angle[1], record.angle[2]);
+        glm::vec4 color(record.color[0], record.color[1], record.color[2], record.color[3]);
+        const char* path = scene.string(record.path);
+        bool dynamic = (record.flags & SCENE_DYNAMIC) != 0;
+        if ((record.flags & SCENE_ATLAS) && path && std::find(atlasPaths.begin(), atlasPaths.end(), path) == atlasPaths.end()) {
+            atlasPaths.push_back(path);
+        }
 
-    // Posts
-    std::vector<glm::vec3> postPositions = {
-        glm::vec3(feetToMeters(-xPos-0.16f), inchesToMeters(4.0f + 12.0f + 12.0f / 2), feetToMeters(-zPos)),
-        glm::vec3(feetToMeters(xPos+0.16f), inchesToMeters(4.0f + 12.0f + 12.0f / 2), feetToMeters(-zPos)),
-        glm::vec3(feetToMeters(-xPos), inchesToMeters(4.0f + 12.0f + 12.0f / 2), feetToMeters(zPos)),
-        glm::vec3(feetToMeters(xPos), inchesToMeters(4.0f + 12.0f + 12.0f / 2), feetToMeters(zPos)),
-        glm::vec3(feetToMeters(0.0f), inchesToMeters(4.0f + 12.0f + 12.0f / 2), feetToMeters(-zPos))
-    };
-    int i = 0;
-    glm::vec3 scale;
-    for (auto& pos : postPositions) {
-        if(i == 2 || i == 3) {
-            scale = glm::vec3(inchesToMeters(5.0f), inchesToMeters(13.0f), inchesToMeters(0.75f));
-        } else if (i == 4) {
-            scale = glm::vec3(inchesToMeters(3.0f), inchesToMeters(13.0f), inchesToMeters(0.75f));
-        } else {
-            scale = glm::vec3(inchesToMeters(1.0f), inchesToMeters(13.0f), inchesToMeters(0.75f));
+        switch (record.type) {
+        case SCENE_CUBE: {
+            auto found = cubeGroups.find(scene.string(record.group));
+            if (found == cubeGroups.end()) {
+                std::cerr << "ERROR::SCENE::UNKNOWN_GROUP " << scene.string(record.group) << std::endl;
+                break;
+            }
+            found->second->push_back(Cube(position, glm::vec3(1.0f, 0.3f, 0.5f), scale, angle, color, path));
+            found->second->back().occluder = (record.flags & SCENE_OCCLUDER) != 0;
+            found->second->back().dynamic = dynamic;
+            found->second->back().mirror = (record.flags & SCENE_MIRROR) != 0;
+            break;
         }
-        Cube post(
-            pos,
-            glm::vec3(1.0f, 0.3f, 0.5f),
-            scale,
-            glm::vec3(0.0f),
-            glm::vec4(0.228f, 0.152f, 0.128f, 1.0f),
-            "./Textures/wood_grain_rot.jpg"
-        );
-        i++;
-        tvStandParts.push_back(post);
+        case SCENE_GAME:
+            wiiGames.push_back(wiiGame(position, glm::vec3(1.0f, 0.3f, 0.5f), scale, angle, color, path));
+            wiiGames.back().dynamic = dynamic;
+            break;
+        case SCENE_TRAPEZOID:
+            wii.push_back(Trapezoid(position, glm::vec3(1.0f, 0.3f, 0.5f), scale, angle, color));
+            wii.back().dynamic = dynamic;
+            break;
+        case SCENE_PYRAMID:
+            tvStands.push_back(Pyramid(position, glm::vec3(0.1f, 0.0f, 0.0f), scale, angle, color));
+            tvStands.back().dynamic = dynamic;
+            break;
+        case SCENE_TOWEL:
+            towels.push_back(Towel(position, scale, angle, color, path ? path : ""));
+            towels.back().dynamic = dynamic;
+            break;
+        case SCENE_LIGHT:
+            clusteredLights.lights.push_back(PointLight{ position, scale.x, glm::vec3(color), color.w });
+            break;
+        }
+    }
+    scene.close();
+
+    // Scatter the extra test lights through the room, the same ones every run
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 0; i < extraLights; i++) {
+        glm::vec3 position(-1.5f + 3.0f * unit(random), 2.0f * unit(random), -0.4f + 1.4f * unit(random));
+        glm::vec3 color(0.3f + 0.7f * unit(random), 0.3f + 0.7f * unit(random), 0.3f + 0.7f * unit(random));
+        clusteredLights.lights.push_back(PointLight{ position, 0.15f + 0.2f * unit(random), color, 0.5f });
     }
 
-    // Top Shelf
-    Cube topShelfHighlight(
-        glm::vec3(-0.58f, inchesToMeters(4.83f + 12.0f + 12.0f + 0.75f / 2), 0.0f),
-        glm::vec3(1.0f, 0.3f, 0.5f),
-        glm::vec3(feetToMeters(1.2f), inchesToMeters(0.1f), feetToMeters(2.0f)),
-        glm::vec3(0.0f), 
-        glm::vec4(1.0f, 1.0f, 1.0f, 0.6f),
-        "./Textures/wall.jpg"
-    );
-    tvStandParts.push_back(topShelfHighlight);
-
-    // Top Shelf
-    Cube topShelf(
-        glm::vec3(0.0f, inchesToMeters(4.5f + 12.0f + 12.0f + 0.75f / 2), 0.0f),
-        glm::vec3(1.0f, 0.3f, 0.5f),
-        glm::vec3(feetToMeters(5.0f), inchesToMeters(0.75f), feetToMeters(2.0f)),
-        glm::vec3(0.0f), 
-        glm::vec4(0.392f, 0.392f, 0.352f, 0.6f)
-    );
-    tvStandParts.push_back(topShelf);
-    // ----------------------------------------------------------------------------
+    // Upload the textures the loader threads decoded while the scene was being built
+    textureCache.finishLoading();
 
-    // Draw the wii sensor bar ----------------------------------------------------
-
-    float topShelfYPos = inchesToMeters(4.5f + 12.0f + 12.0f + 0.75f / 2);
-    std::vector<Cube> sensorBar;
-
-    Cube sensorBarCenter(
-        glm::vec3(0.0f, topShelfYPos + inchesToMeters(0.5f), 0.0f), // Centered position
-        glm::vec3(1.0f, 0.0f, 0.0f),   // Rotation axis (no rotation needed)
-        glm::vec3(inchesToMeters(6.0f), inchesToMeters(0.5f), inchesToMeters(0.7f)), // Scale (6 inches wide)
-        glm::vec3(0.0f),               // No rotation
-        glm::vec4(0.75f, 0.75f, 0.75f, 1.0f)  // Color (Light gray)
-    );
-    sensorBar.push_back(sensorBarCenter);
-
-    Cube sensorBarLeft(
-        glm::vec3(-inchesToMeters(4.0f), topShelfYPos + inchesToMeters(0.5f), 0.0f), // Positioned left of the center (half of the center + half of the left)
-        glm::vec3(1.0f, 0.0f, 0.0f),    // Rotation axis (no rotation needed)
-        glm::vec3(inchesToMeters(2.0f), inchesToMeters(0.5f), inchesToMeters(0.7f)), // Scale (2 inches wide)
-        glm::vec3(0.0f),                // No rotation
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)  // Color (Black)
-    );
-    sensorBar.push_back(sensorBarLeft);
-
-    Cube sensorBarRight(
-        glm::vec3(inchesToMeters(4.0f), topShelfYPos + inchesToMeters(0.5f), 0.0f), // Positioned right of the center (half of the center + half of the right)
-        glm::vec3(1.0f, 0.0f, 0.0f),    // Rotation axis (no rotation needed)
-        glm::vec3(inchesToMeters(2.0f), inchesToMeters(0.5f), inchesToMeters(0.7f)), // Scale (2 inches wide)
-        glm::vec3(0.0f),                // No rotation
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)  // Color (Black)
-    );
-    sensorBar.push_back(sensorBarRight);
+    // Pack the small textures into the atlas and let the objects that use them sample it instead
+    textureAtlas.build(atlasPaths, textureCache.disk);
+    for (auto& group : cubeGroups) {
+        useAtlas(*group.second);
+    }
+    useAtlas(wiiGames);
     // ----------------------------------------------------------------------------
 
-    // Draw the towel -------------------------------------------------------------
-
-    Towel towel(
-        glm::vec3(-0.27f, topShelfYPos - inchesToMeters(0.5f), 0.04f), // Position on the shelf
-        glm::vec3(0.1f),               // Default scale (already folded towel)
-        glm::vec3(0.5f, 90.0f, 0.7f),
-        glm::vec4(0.868f, 0.96f, 0.596f, 1.0f),  // Towel color (Greenish)
-        "./towel.obj"
-    );
-
+    // Bake the static groups picked on the command line ------------------------
+    StaticBatch staticBatch;
+    for (const auto& name : bakedGroups) {
+        auto found = cubeGroups.find(name);
+        if (found == cubeGroups.end()) {
+            std::cerr << "ERROR::BAKE::UNKNOWN_GROUP " << name << std::endl;
+            continue;
+        }
+        staticBatch.bake(name, *found->second, false, geometryRegistry);
+    }
+    bool roomBaked = staticBatch.baked("room");
+    bool tvStandBaked = staticBatch.baked("tvStand");
+    bool sensorBarBaked = staticBatch.baked("sensorBar");
+    bool wiiDetailsBaked = staticBatch.baked("wiiDetails");
+    bool TelevisionBaked = staticBatch.baked("television");
     // ----------------------------------------------------------------------------
 
-    // Draw the wii ---------------------------------------------------------------
-    std::vector<Trapezoid> wii;
-
-    Trapezoid base(
-        glm::vec3( 0.56f,  0.432f,  0.14f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.13f, 0.05f, 0.06f),  // Scale
-        glm::vec3(0.0f, -85.0f, 0.0f),      // Angle
-        glm::vec4(0.44f, 0.42f, 0.42f, 1.0f)    // Color
-    );
-    wii.push_back(base);
-
-    Trapezoid console(
-        glm::vec3( 0.559f,  0.527f,  0.09f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.12f, 0.2f, 0.05f),  // Scale
-        glm::vec3(-10.0f, -85.0f, 0.0f),      // Angle
-        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)    // Color
-    );
-    wii.push_back(console);
-
-    std::vector<Cube> wiiDetails;
-
-    Cube discSlot(
-        glm::vec3( 0.574f,  0.545f,  0.13f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.006f, 0.16f, 0.01f),  // Scale
-        glm::vec3(-18.0f, 0.0f, 1.0f),      // Angle
-        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)    // Color
-    );
-    wiiDetails.push_back(discSlot);
-    Cube powerButton(
-        glm::vec3( 0.545f,  0.61f,  0.115f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.02f, 0.01f, 0.01f),  // Scale
-        glm::vec3(-18.0f, 0.0f, 1.0f),      // Angle
-        glm::vec4(0.95f, 0.95f, 0.95f, 1.0f)    // Color
-    );
-    wiiDetails.push_back(powerButton);
-    Cube buttonLight(
-        glm::vec3( 0.5425f,  0.6125f,  0.121f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.004f, 0.004f, 0.002f),  // Scale
-        glm::vec3(-18.0f, 0.0f, 1.0f),      // Angle
-        glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)    // Color
-    );
-    wiiDetails.push_back(buttonLight);
-    Cube resetButton(
-        glm::vec3( 0.545f,  0.595f,  0.12f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.02f, 0.006f, 0.01f),  // Scale
-        glm::vec3(-18.0f, 0.0f, 1.0f),      // Angle
-        glm::vec4(0.95f, 0.95f, 0.95f, 1.0f)    // Color
-    );
-    wiiDetails.push_back(resetButton);
-    Cube hdmiPort(
-        glm::vec3( 0.545f,  0.545f,  0.138f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.02f, 0.08f, 0.01f),  // Scale
-        glm::vec3(-18.0f, 0.0f, 1.0f),      // Angle
-        glm::vec4(0.95f, 0.95f, 0.95f, 1.0f)    // Color
-    );
-    wiiDetails.push_back(hdmiPort);
-        Cube ejectButton(
-        glm::vec3( 0.548f,  0.48f,  0.157f),
-        glm::vec3(1.0f, 0.3f, 0.5f),    // Rotation
-        glm::vec3(0.02f, 0.01f, 0.01f),  // Scale
-        glm::vec3(-18.0f, 0.0f, 1.0f),      // Angle
-        glm::vec4(0.95f, 0.95f, 0.95f, 1.0f)    // Color
-    );
-    wiiDetails.push_back(ejectButton);
+    // Pack the Cube-based groups that were not baked into instanced batches ------
+    InstancedGroup wiiDetailsBatch, wiiGamesBatch, TelevisionBatch, sensorBarBatch, tvStandBatch;
+    if (instancedRendering) {
+        if (!wiiDetailsBaked) {
+            wiiDetailsBatch.build(wiiDetails, false, geometryRegistry, textureCache);
+        }
+        wiiGamesBatch.build(wiiGames, true, geometryRegistry, textureCache);
+        if (!TelevisionBaked) {
+            TelevisionBatch.build(TelevisionParts, false, geometryRegistry, textureCache);
+        }
+        if (!sensorBarBaked) {
+            sensorBarBatch.build(sensorBar, false, geometryRegistry, textureCache);
+        }
+        if (!tvStandBaked) {
+            tvStandBatch.build(tvStandParts, false, geometryRegistry, textureCache);
+        }
+    }
     // ----------------------------------------------------------------------------
 
-    // Draw the stacks of wii games -----------------------------------------------
-    std::vector<wiiGame> wiiGames;
-
-    glm::vec3 gamePositions[] = {
-        glm::vec3( 0.13f,  0.417f,  0.05f),
-        glm::vec3( 0.13f,  0.437f,  0.055f),
-        glm::vec3( 0.13f,  0.457f,  0.04f),
-        glm::vec3( 0.13f,  0.477f,  0.07f),
-        glm::vec3( 0.13f,  0.497f,  0.05f),
-        glm::vec3( 0.13f,  0.517f,  0.05f),
-        glm::vec3( 0.13f,  0.537f,  0.05f),
-        glm::vec3( 0.13f,  0.557f,  0.09f),
-
-
-        glm::vec3( 0.34f,  0.417f,  0.05f),
-        glm::vec3( 0.32f,  0.437f,  0.07f),
-        glm::vec3( 0.33f,  0.457f,  0.05f),
-        glm::vec3( 0.35f,  0.477f,  0.02f),
-        glm::vec3( 0.34f,  0.497f,  0.05f),
-        glm::vec3( 0.33f,  0.517f,  0.06f),
-        glm::vec3( 0.325f,  0.537f,  0.05f),
-        glm::vec3( 0.34f,  0.557f,  0.03f),
-        glm::vec3( 0.36f,  0.577f,  0.06f)
-    };
-
-    float gameRotations[] = {
-	    0.0f,
-	   -1.0f,
-        3.5f,
-        3.5f,
-	    0.0f,
-        2.0f,
-        5.0f,
-       -5.0f,
-
-
-    	0.0f,
-       -2.5f,
-       -0.5f,
-        0.0f,
-	    1.0f,
-        3.0f,
-        3.0f,
-        0.0f,
-       -6.5f
-    };    
-
-    const char* gameTextures[] = {
-        "./Textures/game1.jpg",
-        "./Textures/game3.jpg",
-        "./Textures/game4.jpg",
-        "./Textures/game5.jpg",
-        "./Textures/game6.jpg",
-        "./Textures/game7.jpg",
-        "./Textures/game8.jpg",
-        "./Textures/game2.jpg",
-
-        "./Textures/game9.jpg",
-        "./Textures/game10.jpg",
-        "./Textures/game11.jpg",
-        "./Textures/game12.jpg",
-        "./Textures/game13.jpg",
-        "./Textures/game14.jpg",
-        "./Textures/game12.jpg",
-        "./Textures/game13.jpg",
-        "./Textures/game3.jpg",
+    // Bounding volume hierarchy over every object, culled against the view frustum each frame
+    std::vector<AABB> bounds;
+    size_t wiiFirst = addBounds(bounds, wii);
+    size_t wiiDetailsFirst = addBounds(bounds, wiiDetails);
+    size_t wiiGamesFirst = addBounds(bounds, wiiGames);
+    size_t TelevisionFirst = addBounds(bounds, TelevisionParts);
+    size_t sensorBarFirst = addBounds(bounds, sensorBar);
+    size_t towelsFirst = addBounds(bounds, towels);
+    size_t roomFirst = addBounds(bounds, room);
+    size_t tvStandFirst = addBounds(bounds, tvStandParts);
+    size_t tvStandsFirst = addBounds(bounds, tvStands);
+    size_t bakedFirst = addBounds(bounds, staticBatch.meshes);
+    BoundingVolumeHierarchy bvh;
+    bvh.build(bounds);
+    // The shadow map is aimed so the whole scene is inside it
+    AABB sceneBounds;
+    for (const auto& box : bounds) {
+        sceneBounds.add(box);
+    }
+    std::vector<char> visible;
+    // Each object's draw item, built on the job system and indexed like bounds
+    std::vector<DrawItem> drawItems(bounds.size());
+    std::vector<char> drawn(bounds.size(), 0);
+    // The same for the objects seen in the planar reflection
+    std::vector<char> reflectionVisible;
+    std::vector<DrawItem> reflectionItems(bounds.size());
+    std::vector<char> reflectionDrawn(bounds.size(), 0);
+
+    // Builds the matrices and uniforms of every object marked in shown across the worker threads and queues
+    // them for a camera looking through sceneView. Opaque objects of a baked group are drawn by its baked meshes
+    // instead. items and queued are indexed like bounds.
+    auto queueScene = [&](RenderQueue& queue, const glm::mat4& sceneView, const std::vector<char>& shown,
+                          std::vector<DrawItem>& items, std::vector<char>& queued) {
+        profiler.push("Prepare draws");
+        JobGroup prepare;
+        prepareGroup(prepare, ourShader, wii, wiiFirst, false, shown, items, queued, "Wii");
+        prepareGroup(prepare, ourShader, wiiDetails, wiiDetailsFirst, instancedRendering || wiiDetailsBaked, shown, items, queued, "Wii details");
+        prepareGroup(prepare, ourShader, wiiGames, wiiGamesFirst, instancedRendering, shown, items, queued, "Wii games");
+        prepareGroup(prepare, ourShader, TelevisionParts, TelevisionFirst, instancedRendering || TelevisionBaked, shown, items, queued, "Television");
+        prepareGroup(prepare, ourShader, sensorBar, sensorBarFirst, instancedRendering || sensorBarBaked, shown, items, queued, "Sensor bar");
+        prepareGroup(prepare, ourShader, towels, towelsFirst, false, shown, items, queued, "Towel");
+        prepareGroup(prepare, ourShader, room, roomFirst, roomBaked, shown, items, queued, "Room");
+        prepareGroup(prepare, ourShader, tvStandParts, tvStandFirst, instancedRendering || tvStandBaked, shown, items, queued, "TV stand");
+        prepareGroup(prepare, ourShader, tvStands, tvStandsFirst, false, shown, items, queued, "TV stand legs");
+        prepareGroup(prepare, ourShader, staticBatch.meshes, bakedFirst, false, shown, items, queued, "Baked");
+        jobs.wait(prepare);
+        profiler.pop();
+
+        // Collect the draws, the GL thread only uploads the instanced batches and queues finished items
+        queue.begin(sceneView);
+
+        // Queue the wii
+        submitPrepared(queue, items, queued, wiiFirst, wii.size(), "Wii");
+
+        // Queue the wii details, game stacks, television and sensor bar
+        submitGroup(queue, ourShader, wiiDetails, wiiDetailsBatch, shown, items, queued, wiiDetailsFirst, "Wii details");
+        submitGroup(queue, ourShader, wiiGames, wiiGamesBatch, shown, items, queued, wiiGamesFirst, "Wii games");
+        submitGroup(queue, ourShader, TelevisionParts, TelevisionBatch, shown, items, queued, TelevisionFirst, "Television");
+        submitGroup(queue, ourShader, sensorBar, sensorBarBatch, shown, items, queued, sensorBarFirst, "Sensor bar");
+
+        // Queue the towel and the room
+        submitPrepared(queue, items, queued, towelsFirst, towels.size(), "Towel");
+        submitPrepared(queue, items, queued, roomFirst, room.size(), "Room");
+
+        // Queue the TV stand parts and legs
+        submitGroup(queue, ourShader, tvStandParts, tvStandBatch, shown, items, queued, tvStandFirst, "TV stand");
+        submitPrepared(queue, items, queued, tvStandsFirst, tvStands.size(), "TV stand legs");
+
+        // Queue the baked static groups
+        submitPrepared(queue, items, queued, bakedFirst, staticBatch.meshes.size(), "Baked");
     };
 
-    glm::vec4 colors[] = {
-        glm::vec4(0.904f, 0.88f, 0.832f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-        glm::vec4(0.904f, 0.88f, 0.832f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-        glm::vec4(0.982f, 0.984f, 0.96f, 1.0f),
-        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-        glm::vec4(0.928f, 0.94f, 0.9f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-        glm::vec4(0.928f, 0.94f, 0.9f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-        glm::vec4(0.982f, 0.964f, 0.932f, 1.0f),
-    };
+    // Opaque occluder cubes, isOccluder is indexed like bounds so occluders are not tested against themselves.
+    // The first cube marked mirror shows the planar reflection.
+    std::vector<const Cube*> occluders;
+    std::vector<char> isOccluder(bounds.size(), 0);
+    const Cube* mirror = nullptr;
+    size_t mirrorIndex = 0;
+    for (auto& group : { std::make_pair(&room, roomFirst), std::make_pair(&tvStandParts, tvStandFirst),
+                         std::make_pair(&TelevisionParts, TelevisionFirst), std::make_pair(&sensorBar, sensorBarFirst),
+                         std::make_pair(&wiiDetails, wiiDetailsFirst) }) {
+        for (size_t i = 0; i < group.first->size(); i++) {
+            const Cube& cube = (*group.first)[i];
+            if (cube.occluder && cube.color.w >= 1.0f) {
+                occluders.push_back(&cube);
+                isOccluder[group.second + i] = 1;
+            }
+            if (cube.mirror && !mirror) {
+                mirror = &cube;
+                mirrorIndex = group.second + i;
+            }
+        }
+    }
 
-    i = 0;
-    for (auto& pos : gamePositions) {
-        wiiGame game(
-            pos,
-            glm::vec3(1.0f, 0.3f, 0.5f),
-            glm::vec3(0.17f, 0.3f, 0.02f),
-            glm::vec3(90.0f, 0.0f, gameRotations[i]),
-            colors[i],
-            gameTextures[i]
-        );
-        i++;
-        wiiGames.push_back(game);
+    if (mirror) {
+        reflection.create(WIDTH, HEIGHT);
+    }
+    dynamicResolution.create(WIDTH, HEIGHT);
+    if (window) {
+        redrawTracker.create(WIDTH, HEIGHT);
+        // Repaint the window with the last frame when the window system asks for it
+        glfwSetWindowRefreshCallback(window, [](GLFWwindow*) { redrawTracker.expose(); });
     }
-    // ----------------------------------------------------------------------------
 
-    // Draw the Television --------------------------------------------------------
-    std::vector<Cube> TelevisionParts;
-
-    // Create TV
-    Cube tvCase(
-        glm::vec3(0.0f, 1.11f, 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(3.5f), inchesToMeters(23.0f), feetToMeters(0.1f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.352f, 0.352f, 0.352f, 1.0f)
-    );
-    TelevisionParts.push_back(tvCase);
-    // Create TV
-    Cube tvScreen(
-        glm::vec3(0.0f, 1.11f, 0.001f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(3.45f), inchesToMeters(22.5f), feetToMeters(0.1f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.168f, 0.168f, 0.168f, 0.9f),                    // Color (wooden)
-        "./Textures/tv.jpg"
-    );
-    TelevisionParts.push_back(tvScreen);
-
-    Cube bottomBar(
-        glm::vec3(0.0f, 0.81f, 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(3.52f), inchesToMeters(0.8f), feetToMeters(0.125f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.352f, 0.352f, 0.352f, 1.0f)
-    );
-    TelevisionParts.push_back(bottomBar);
-
-    Cube redLight(
-        glm::vec3(-0.05f, 0.795f, 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.02f), inchesToMeters(0.25f), feetToMeters(0.05f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)
-    );
-    TelevisionParts.push_back(redLight);
-
-    Cube redCase(
-        glm::vec3(-0.05f, 0.795f, 0.0f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.08f), inchesToMeters(0.35f), feetToMeters(0.05f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.776f, 0.268f, 0.276f, 0.7f)
-    );
-    TelevisionParts.push_back(redCase);
-
-    Cube sticker1(
-        glm::vec3(-0.4965f, 1.30f, 0.01f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.18f), inchesToMeters(6.5f), feetToMeters(0.05f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.848f, 0.756f, 0.092f, 1.0f)
-    );
-    TelevisionParts.push_back(sticker1);
-
-    Cube sticker2(
-        glm::vec3(0.4965f, 1.365f, 0.01f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.18f), inchesToMeters(2.20f), feetToMeters(0.05f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.848f, 0.756f, 0.092f, 1.0f)
-    );
-    TelevisionParts.push_back(sticker2);
-
-    Cube sticker3(
-        glm::vec3(0.471f, 0.875f, 0.01f), // Position
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.18f), inchesToMeters(1.10f), feetToMeters(0.05f)), // Scale
-        glm::vec3(0.0f),                                                    // Angle
-        glm::vec4(0.996f, 0.98f, 0.972f, 1.0f)
-    );
-    TelevisionParts.push_back(sticker3);
-    Cube tvStandConnect1(
-        glm::vec3(0.431f, 0.79f, 0.0f),
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.058f), inchesToMeters(1.60f), feetToMeters(0.075f)),
-        glm::vec3(0.0f, 0.0f, 0.0f),                                                    // Angle
-        glm::vec4(0.18f, 0.188f, 0.184f, 1.0f)
-    );
-    TelevisionParts.push_back(tvStandConnect1);
-
-    Cube tvStandConnect2(
-        glm::vec3(-0.431f, 0.79f, 0.0f),
-        glm::vec3(1.0f, 0.3f, 0.5f),                                        // Rotation axis
-        glm::vec3(feetToMeters(0.058f), inchesToMeters(1.60f), feetToMeters(0.075f)),
-        glm::vec3(0.0f, 0.0f, 0.0f),                                                    // Angle
-        glm::vec4(0.18f, 0.188f, 0.184f, 1.0f)
-    );
-    TelevisionParts.push_back(tvStandConnect2);
+    renderQueue.jobs = &jobs;
+    shadowQueue.jobs = &jobs;
+    reflectionQueue.jobs = &jobs;
 
-    std::vector<Pyramid> tvStands;
-    Pyramid stand1;
-    stand1.position = glm::vec3(0.44f, 0.76f, 0.05f);
-    stand1.angle = glm::vec3(115.0f, 0.0f, -10.0f);
-    stand1.scale = glm::vec3(feetToMeters(0.06f), inchesToMeters(5.10f), feetToMeters(0.075f));
-    stand1.color = glm::vec4(0.18f, 0.188f, 0.184f, 1.0f);
-    tvStands.push_back(stand1);
-    
-    Pyramid stand2;
-    stand2.position = glm::vec3(0.44f, 0.76f, -0.055f);
-    stand2.angle = glm::vec3(70.0f, 0.0f, -170.0f);
-    stand2.scale = glm::vec3(feetToMeters(0.06f), inchesToMeters(5.10f), feetToMeters(0.075f));
-    stand2.color = glm::vec4(0.18f, 0.188f, 0.184f, 1.0f);
-    tvStands.push_back(stand2);
-
-    Pyramid stand3;
-    stand3.position = glm::vec3(-0.44f, 0.76f, 0.05f);
-    stand3.angle = glm::vec3(115.0f, 0.0f, 10.0f);
-    stand3.scale = glm::vec3(feetToMeters(0.06f), inchesToMeters(5.10f), feetToMeters(0.075f));
-    stand3.color = glm::vec4(0.18f, 0.188f, 0.184f, 1.0f);
-    tvStands.push_back(stand3);
-    
-    Pyramid stand4;
-    stand4.position = glm::vec3(-0.44f, 0.76f, -0.055f);
-    stand4.angle = glm::vec3(70.0f, 0.0f, -190.0f);
-    stand4.scale = glm::vec3(feetToMeters(0.06f), inchesToMeters(5.10f), feetToMeters(0.075f));
-    stand4.color = glm::vec4(0.18f, 0.188f, 0.184f, 1.0f);
-    tvStands.push_back(stand4);
-    // ----------------------------------------------------------------------------
+    // Time every frame once the scene is loaded
+    if (!tracePath.empty()) {
+        profiler.start();
+        renderQueue.profiler = &profiler;
+        shadowQueue.profiler = &profiler;
+    }
+
+    // Report how much the shared shapes and textures save, and what baking traded
+    geometryRegistry.report();
+    textureCache.report();
+    textureAtlas.report();
+    staticBatch.report();
 
+    // Frame timing for the benchmark
+    FrameTimer frameTimer;
+    int frame = 0;
 
     // Game loop
-    while (!glfwWindowShouldClose(window))
+    while (window ? !glfwWindowShouldClose(window) : frame < benchmarkFrames)
     {
-        // Check if any events have been activated (key pressed, mouse moved etc.) and call corresponding response functions
-        glfwPollEvents();
-        // Calculate deltatime
-        GLfloat currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        if (window) {
+            // Check if any events have been activated (key pressed, mouse moved etc.) and call corresponding response functions
+            glfwPollEvents();
+            // Skip the frame when the window already shows the current scene. A repaint shows the last frame
+            // again, otherwise sleep until an event arrives and check again.
+            if (redrawTracker.enabled) {
+                unsigned long version = sceneVersion(wii) + sceneVersion(wiiDetails) + sceneVersion(wiiGames) +
+                                        sceneVersion(TelevisionParts) + sceneVersion(sensorBar) + sceneVersion(towels) +
+                                        sceneVersion(room) + sceneVersion(tvStandParts) + sceneVersion(tvStands);
+                if (!redrawTracker.changed(camera.GetViewMatrix(), lightPos, version)) {
+                    if (redrawTracker.takeExposed()) {
+                        redrawTracker.present();
+                        glfwSwapBuffers(window);
+                    } else {
+                        redrawTracker.waited();
+                        glfwWaitEvents();
+                        // Time asleep does not count as time between frames
+                        lastFrame = glfwGetTime();
+                    }
+                    continue;
+                }
+            }
+            // Calculate deltatime
+            GLfloat currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+        }
+        frameTimer.beginFrame();
+        profiler.beginFrame();
+
+        // Pick this frame's resolution from the GPU time of the latest measured frame and draw offscreen at it
+        dynamicResolution.update(frameTimer.lastGpuMs, frameTimer.lastGpuFrame);
+        dynamicResolution.begin();
 
         // Handle Input
         // do_movement();
 
-        // Set up the OpenGL state and return the objectColorLoc and modelLoc
-        SetupOpenGLState(ourShader, objectColorLoc, modelLoc);
-
-        // Bind the objects VAO
-        glBindVertexArray(wii[0].VAO); 
-        // Draw the wii
-        for (const auto& piece : wii)
+        // Set up the OpenGL state and the per-frame uniforms
         {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), piece.color.w);
-            piece.draw(ourShader, objectColorLoc, modelLoc);
+            ProfileScope scope(profiler, "SetupOpenGLState", true);
+            SetupOpenGLState(ourShader);
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
-
-        // Bind the objects VAO
-        glBindVertexArray(wiiDetails[0].VAO); 
-        // Draw the wii game stacks
-        for (const auto& detail : wiiDetails)
-        {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), detail.color.w);
-            detail.draw(ourShader, objectColorLoc, modelLoc);
+        // Window positions in the shaders follow the resolution the frame is drawn at
+        if (dynamicResolution.enabled()) {
+            glm::vec4 params = clusteredLights.params();
+            params.x *= dynamicResolution.scale;
+            params.y *= dynamicResolution.scale;
+            ourShader.setVec4("clusterParams", params);
+            ourShader.setVec2("viewportSize", glm::vec2(dynamicResolution.scaledWidth(), dynamicResolution.scaledHeight()));
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
-
-        // Bind the objects VAO
-        glBindVertexArray(wiiGames[0].VAO); 
-        // Draw the wii game stacks
-        for (const auto& game : wiiGames)
-        {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), game.color.w);
-            game.draw(ourShader, objectColorLoc, modelLoc);
+        geometryRegistry.beginFrame();
+
+        // Find the objects inside the view frustum
+        glm::mat4 view = camera.GetViewMatrix();
+        glm::mat4 viewProjection = GetProjectionMatrix() * view;
+        profiler.push("Culling");
+        bvh.cull(Frustum(viewProjection), visible);
+
+        // Drop the objects hidden behind the occluders
+        if (occlusionCulling && !occluders.empty()) {
+            occlusionCuller.begin(viewProjection);
+            for (const Cube* cube : occluders) {
+                occlusionCuller.addBox(cube->transform.world());
+            }
+            occlusionCuller.rasterize(jobs);
+            JobGroup tests;
+            jobs.parallelFor(tests, visible.size(), JOB_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    if (visible[i] && !isOccluder[i]) {
+                        visible[i] = occlusionCuller.visible(bounds[i]);
+                    }
+                }
+            });
+            jobs.wait(tests);
+            occlusionCuller.endFrame();
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
-        
-        // Bind the objects VAO
-        glBindVertexArray(TelevisionParts[0].VAO); 
-        // Draw the wii game stacks
-        for (const auto& part : TelevisionParts)
-        {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), part.color.w);
-            part.draw(ourShader, objectColorLoc, modelLoc);
+        profiler.pop();
+
+        // Sort the point lights into the clusters of the view frustum
+        profiler.push("Light clusters");
+        clusteredLights.update(view, jobs);
+        profiler.pop();
+
+        // Redraw the cached shadow map only when the light or a static caster moved, then draw the dynamic
+        // casters over a copy of it
+        profiler.push("Shadow map");
+        unsigned long staticVersion = casterVersion(wii) + casterVersion(wiiDetails) + casterVersion(wiiGames) +
+                                      casterVersion(TelevisionParts) + casterVersion(sensorBar) + casterVersion(towels) +
+                                      casterVersion(room) + casterVersion(tvStandParts) + casterVersion(tvStands);
+        if (shadowMap.update(lightPos, sceneBounds, staticVersion)) {
+            shadowQueue.begin(shadowMap.lightSpace);
+            submitCasters(shadowQueue, shadowShader, wii, false, false);
+            submitCasters(shadowQueue, shadowShader, wiiDetails, wiiDetailsBaked, false);
+            submitCasters(shadowQueue, shadowShader, wiiGames, false, false);
+            submitCasters(shadowQueue, shadowShader, TelevisionParts, TelevisionBaked, false);
+            submitCasters(shadowQueue, shadowShader, sensorBar, sensorBarBaked, false);
+            submitCasters(shadowQueue, shadowShader, towels, false, false);
+            submitCasters(shadowQueue, shadowShader, room, roomBaked, false);
+            submitCasters(shadowQueue, shadowShader, tvStandParts, tvStandBaked, false);
+            submitCasters(shadowQueue, shadowShader, tvStands, false, false);
+            for (const auto& mesh : staticBatch.meshes) {
+                submitCaster(shadowQueue, mesh.drawItem(shadowShader), "Shadow map");
+            }
+            shadowShader.Use();
+            shadowShader.setMat4("lightSpace", shadowMap.lightSpace);
+            shadowMap.beginStatic();
+            shadowQueue.flush(geometryRegistry);
+            shadowMap.end();
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
-
-        // Bind the objects VAO
-        glBindVertexArray(sensorBar[0].VAO); 
-        // Draw the wii sensor bar
-        for (const auto& part : sensorBar)
-        {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), part.color.w);
-            part.draw(ourShader, objectColorLoc, modelLoc);
+        AABB dynamicCasters;
+        addDynamicBounds(dynamicCasters, wii, false);
+        addDynamicBounds(dynamicCasters, wiiDetails, wiiDetailsBaked);
+        addDynamicBounds(dynamicCasters, wiiGames, false);
+        addDynamicBounds(dynamicCasters, TelevisionParts, TelevisionBaked);
+        addDynamicBounds(dynamicCasters, sensorBar, sensorBarBaked);
+        addDynamicBounds(dynamicCasters, towels, false);
+        addDynamicBounds(dynamicCasters, room, roomBaked);
+        addDynamicBounds(dynamicCasters, tvStandParts, tvStandBaked);
+        addDynamicBounds(dynamicCasters, tvStands, false);
+        bool dynamicShadows = dynamicCasters.min.x <= dynamicCasters.max.x;
+        if (dynamicShadows) {
+            shadowQueue.begin(shadowMap.lightSpace);
+            submitCasters(shadowQueue, shadowShader, wii, false, true);
+            submitCasters(shadowQueue, shadowShader, wiiDetails, wiiDetailsBaked, true);
+            submitCasters(shadowQueue, shadowShader, wiiGames, false, true);
+            submitCasters(shadowQueue, shadowShader, TelevisionParts, TelevisionBaked, true);
+            submitCasters(shadowQueue, shadowShader, sensorBar, sensorBarBaked, true);
+            submitCasters(shadowQueue, shadowShader, towels, false, true);
+            submitCasters(shadowQueue, shadowShader, room, roomBaked, true);
+            submitCasters(shadowQueue, shadowShader, tvStandParts, tvStandBaked, true);
+            submitCasters(shadowQueue, shadowShader, tvStands, false, true);
+            shadowShader.Use();
+            shadowShader.setMat4("lightSpace", shadowMap.lightSpace);
+            shadowMap.beginDynamic(dynamicCasters);
+            shadowQueue.flush(geometryRegistry);
+            shadowMap.end();
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
-
-        // Bind the objects VAO
-        glBindVertexArray(towel.VAO); 
-        // Set the object color alpha value to the part's alpha
-        glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), towel.color.w);
-        towel.draw(ourShader, objectColorLoc, modelLoc);
-        // Unbind the objects VAO
-        glBindVertexArray(0);
-
-        // Bind the objects VAO
-        glBindVertexArray(Wall.VAO); 
-        // Set the object color alpha value to the part's alpha
-        glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), Wall.color.w);
-        Wall.draw(ourShader, objectColorLoc, modelLoc);
-        // Unbind the objects VAO
-        glBindVertexArray(0); 
-
-        // Bind the objects VAO
-        glBindVertexArray(Trim.VAO); 
-        // Set the object color alpha value to the part's alpha
-        glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), Trim.color.w);
-        Trim.draw(ourShader, objectColorLoc, modelLoc);
-        // Unbind the objects VAO
-        glBindVertexArray(0); 
-
-        // Bind the objects VAO
-        glBindVertexArray(Floor.VAO); 
-        // Set the object color alpha value to the part's alpha
-        glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), Floor.color.w);
-        Floor.draw(ourShader, objectColorLoc, modelLoc);
-        // Unbind the objects VAO
-        glBindVertexArray(0); 
-
-        // Bind the objects VAO
-        glBindVertexArray(tvStandParts[0].VAO);    
-        // Draw the TV stand parts
-        for (const auto& part : tvStandParts)
-        {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), part.color.w);
-            part.draw(ourShader, objectColorLoc, modelLoc);
+        shadowMap.bind(dynamicShadows);
+        ourShader.Use();
+        ourShader.setMat4("lightSpace", shadowMap.lightSpace);
+        profiler.pop();
+
+        // Redraw the reflection in the mirror's front face through the mirrored camera when it is due. Whatever is
+        // behind the mirror, including the mirror itself, is culled here and clipped in the vertex shader.
+        if (mirror) {
+            reflection.setPlane(glm::vec3(mirror->transform.world() * glm::vec4(0.0f, 0.0f, 0.5f, 1.0f)),
+                                mirror->transform.normal() * glm::vec3(0.0f, 0.0f, 1.0f));
+            if (reflection.due(view, camera.Position)) {
+                ProfileScope scope(profiler, "Reflection", true);
+                bvh.cull(Frustum(GetProjectionMatrix() * reflection.view), reflectionVisible);
+                reflection.cull(bounds, reflectionVisible);
+                reflectionVisible[mirrorIndex] = 0;
+                queueScene(reflectionQueue, reflection.view, reflectionVisible, reflectionItems, reflectionDrawn);
+
+                ourShader.Use();
+                ourShader.setMat4("view", reflection.view);
+                ourShader.setVec3("viewPos", reflection.position);
+                ourShader.setVec4("clipPlane", reflection.plane);
+                ourShader.setBool("reflectionPass", true);
+                reflection.begin();
+                reflectionQueue.flush(geometryRegistry);
+                reflection.end();
+                ourShader.Use();
+                ourShader.setMat4("view", view);
+                ourShader.setVec3("viewPos", camera.Position);
+                ourShader.setBool("reflectionPass", false);
+            }
+            reflection.bind();
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
 
-        // Bind the objects VAO
-        glBindVertexArray(tvStands[0].VAO); 
-        for (const auto& part : tvStands)
-        {
-            // Set the object color alpha value to the part's alpha
-            glUniform1f(glGetUniformLocation(ourShader.Program, "objectAlpha"), part.color.w);
-            part.draw(ourShader, objectColorLoc, modelLoc);
+        // Build and queue the draws of every visible object
+        queueScene(renderQueue, view, visible, drawItems, drawn);
+
+        // Draw opaque objects sorted by state, then transparent ones back to front
+        profiler.push("Render queue");
+        renderQueue.flush(geometryRegistry);
+        profiler.pop();
+
+        // Stretch the frame over the window
+        profiler.push("Upscale");
+        dynamicResolution.end();
+        profiler.pop();
+
+        frameTimer.endFrame();
+        frame++;
+
+        // Keep the frame to show again when the window only needs repainting
+        if (window) {
+            redrawTracker.store();
         }
-        // Unbind the objects VAO
-        glBindVertexArray(0);
 
         // Swap the screen buffers
-        glfwSwapBuffers(window);
-    }
-    // Cleanup: Delete the VAOs and VBOs for each object to avoid memory leaks.
-    
-    // Background cubes
-    glDeleteVertexArrays(1, &Wall.VAO);
-    glDeleteBuffers(1, &Wall.VBO);
-    glDeleteVertexArrays(1, &Trim.VAO);
-    glDeleteBuffers(1, &Trim.VBO);
-    glDeleteVertexArrays(1, &Floor.VAO);
-    glDeleteBuffers(1, &Floor.VBO);
-
-    // TV Stand Parts
-    for (auto& part : tvStandParts) {
-        glDeleteVertexArrays(1, &part.VAO);
-        glDeleteBuffers(1, &part.VBO);
+        profiler.push("Swap");
+        if (window) {
+            glfwSwapBuffers(window);
+        } else {
+            glFlush();
+        }
+        profiler.pop();
+        profiler.endFrame();
     }
 
-    // Wii and Wii details
-    for (auto& piece : wii) {
-        glDeleteVertexArrays(1, &piece.VAO);
-        glDeleteBuffers(1, &piece.VBO);
-    }
-    for (auto& detail : wiiDetails) {
-        glDeleteVertexArrays(1, &detail.VAO);
-        glDeleteBuffers(1, &detail.VBO);
+    // Report the benchmark results
+    frameTimer.finish();
+    if (!window) {
+        std::string json = frameTimer.toJson((const char*)glGetString(GL_RENDERER), WIDTH, HEIGHT);
+        if (benchmarkOutput.empty()) {
+            std::cout << json;
+        } else {
+            std::ofstream(benchmarkOutput) << json;
+        }
     }
-
-    // Wii Games
-    for (auto& game : wiiGames) {
-        glDeleteVertexArrays(1, &game.VAO);
-        glDeleteBuffers(1, &game.VBO);
+    frameTimer.destroy();
+    // Write the trace
+    profiler.finish();
+    profiler.report();
+    if (!tracePath.empty()) {
+        profiler.writeTrace(tracePath);
     }
-
-    // TV
-    for (auto& part : TelevisionParts) {
-        glDeleteVertexArrays(1, &part.VAO);
-        glDeleteBuffers(1, &part.VBO);
+    profiler.destroy();
+    // Cleanup: Delete the VAOs and VBOs for each object to avoid memory leaks.
+    
+    // Shared shapes and the towel mesh
+    geometryRegistry.beginFrame();
+    geometryRegistry.report();
+    geometryRegistry.destroy();
+    renderQueue.report();
+    renderQueue.destroy();
+    bvh.report();
+    occlusionCuller.report();
+    clusteredLights.report();
+    clusteredLights.destroy();
+    shadowQueue.report();
+    shadowQueue.destroy();
+    shadowMap.report();
+    shadowMap.destroy();
+    reflectionQueue.report();
+    reflectionQueue.destroy();
+    reflection.report();
+    reflection.destroy();
+    dynamicResolution.report();
+    dynamicResolution.destroy();
+    redrawTracker.report();
+    redrawTracker.destroy();
+    jobs.report();
+    jobs.destroy();
+
+    // Instanced batches
+    for (auto* batch : {&wiiDetailsBatch, &wiiGamesBatch, &TelevisionBatch, &sensorBarBatch, &tvStandBatch}) {
+        batch->destroy(textureCache);
     }
 
-    // Sensor Bar
-    for (auto& part : sensorBar) {
-        glDeleteVertexArrays(1, &part.VAO);
-        glDeleteBuffers(1, &part.VBO);
+    // Release the shared textures
+    for (const auto* group : {&room, &tvStandParts, &sensorBar, &wiiDetails, &TelevisionParts}) {
+        for (const auto& part : *group) {
+            if (part.textureID != -1) {
+                textureCache.release(part.textureID);
+            }
+        }
     }
-
-    // Towel
-    glDeleteVertexArrays(1, &towel.VAO);
-    glDeleteBuffers(1, &towel.VBO);
-
-    // TV Stand legs
-    for (auto& stand : tvStands) {
-        glDeleteVertexArrays(1, &stand.VAO);
-        glDeleteBuffers(1, &stand.VBO);
+    for (const auto& game : wiiGames) {
+        if (game.textureID != -1) {
+            textureCache.release(game.textureID);
+        }
     }
+    textureAtlas.destroy();
+    textureCache.destroy();
 
     // Terminate GLFW, clearing any resources allocated by GLFW.
-    glfwTerminate();
+    if (window) {
+        glfwTerminate();
+    } else {
+        headless.destroy();
+    }
     return 0;
 }
 
@@ -1668,6 +1342,36 @@ GLFWwindow* windowInit()
     // Initialize GLEW to setup the OpenGL Function pointers
     glewInit();
 
+    renderStateInit();
+
+    return window;
+}
+
+// Offscreen context initialization function for the headless benchmark
+bool headlessInit()
+{
+    if (!headless.create()) {
+        return false;
+    }
+
+    // glewInit also wants a GLX display, the context part is all an EGL context needs
+    glewExperimental = GL_TRUE;
+    if (glewContextInit() != GLEW_OK) {
+        std::cerr << "ERROR::HEADLESS::GLEW_INIT_FAILED" << std::endl;
+        return false;
+    }
+
+    // Render into an offscreen framebuffer the size of the window
+    headless.createFramebuffer(WIDTH, HEIGHT);
+
+    renderStateInit();
+
+    return true;
+}
+
+// Fixed OpenGL state shared by the window and the headless context
+void renderStateInit()
+{
     // Define the viewport dimensions
     glViewport(0, 0, WIDTH, HEIGHT);
     // Camera/View transformation
@@ -1678,41 +1382,29 @@ GLFWwindow* windowInit()
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    return window;
 }
 
 // Initialization Function for OpenGL state
-void SetupOpenGLState(Shader& ourShader, GLint& objectColorLoc, GLint& modelLoc) {
+void SetupOpenGLState(Shader& ourShader) {
     // Clear the color buffer
     glClearColor(0.894f, 0.824f, 0.980f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Use corresponding shader when setting uniforms/drawing objects
     ourShader.Use();
-    // Grab lighting variables
-    objectColorLoc = glGetUniformLocation(ourShader.Program, "objectColor");
-    GLint lightColorLoc  = glGetUniformLocation(ourShader.Program, "lightColor");
-    GLint lightPosLoc    = glGetUniformLocation(ourShader.Program, "lightPos");
-    GLint viewPosLoc     = glGetUniformLocation(ourShader.Program, "viewPos");
 
-    // Set variables
-    glUniform3f(lightColorLoc,  1.0f, 1.0f, 1.0f);
-    glUniform3f(lightPosLoc,    lightPos.x, lightPos.y, lightPos.z);
-    glUniform3f(viewPosLoc,     camera.Position.x, camera.Position.y, camera.Position.z);
+    // Set lighting variables
+    ourShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
+    ourShader.setVec3("lightPos", lightPos);
+    ourShader.setVec3("viewPos", camera.Position);
 
     // Create camera transformations
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
-
-    // Get the uniform locations for model, view, and projection
-    modelLoc = glGetUniformLocation(ourShader.Program, "model");
-    GLint viewLoc  = glGetUniformLocation(ourShader.Program, "view");
-    GLint projLoc  = glGetUniformLocation(ourShader.Program, "projection");
+    glm::mat4 projection = GetProjectionMatrix();
 
     // Pass the matrices to the shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    ourShader.setMat4("view", view);
+    ourShader.setMat4("projection", projection);
 }
 
 // Is called whenever a key is pressed/released via GLFW
@@ -1771,3 +1463,8 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 
     camera.ProcessMouseMovement(xoffset/3, yoffset/3);
 }	
+
+// Perspective projection of the camera
+glm::mat4 GetProjectionMatrix() {
+    return glm::perspective(glm::radians(camera.Zoom), (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+}
@@ -4,23 +4,113 @@ out vec4 FragColor;
 in vec3 Normal;  
 in vec3 FragPos;  
 in vec2 TexCoord;
+in vec4 InstanceColor;
+flat in vec2 InstanceParams;
+flat in uint DrawIndex;
+in float ViewDepth;
+in vec4 LightSpacePos;
 
 // Uniforms for lighting and material properties
 uniform vec3 lightPos; 
 uniform vec3 viewPos; 
 uniform vec3 lightColor;
-uniform vec3 objectColor;
-uniform float objectAlpha;
+
+// Per-draw data, one record per draw in the render queue's draw ring (DrawRing.h)
+struct DrawRecord {
+    mat4 model;
+    mat3 normalMatrix;  // Inverse transpose of model, computed once on the CPU
+    vec4 objectColor;   // rgb and alpha
+    ivec4 drawFlags;    // instanced, useTexture, brighter, mirror
+    vec4 uvRect;        // Offset and scale of TexCoord into the texture, the object's region of an atlas
+};
+// The window of the ring the current draws read, DrawRing::RECORDS_PER_WINDOW long
+layout (std140) uniform DrawData {
+    DrawRecord draws[102];
+};
+
+// Small point lights sorted into clusters of the view frustum by ClusteredLights.h
+const ivec3 CLUSTER_COUNTS = ivec3(16, 12, 24);
+uniform samplerBuffer lightData;        // Two texels per light: position and radius, color and intensity
+uniform usamplerBuffer clusterGrid;     // Offset into lightIndices and light count of every cluster
+uniform usamplerBuffer lightIndices;
+uniform vec4 clusterParams;             // Tile width and height in pixels, depth slice scale and bias
+
+// Depth of the scene light's shadow casters, compared in hardware (ShadowMap.h)
+uniform sampler2DShadow shadowMap;
+
+// Mirror image of the scene drawn by PlanarReflection.h, looked up at the fragment's place in the window
+uniform sampler2D reflectionMap;
+uniform vec2 viewportSize;
+// Set while the reflection itself is drawn, the point light clusters only fit the main camera
+uniform bool reflectionPass;
 
 uniform sampler2D texture1; 
-uniform bool useTexture; 
-uniform bool brighter;
+
+// Instanced draws take their material from the instance attributes and sample a texture array
+uniform sampler2DArray textureArray;
+
+// Diffuse and specular light from the point lights of the fragment's cluster
+vec3 clusterLighting(vec3 norm, vec3 viewDir)
+{
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterParams.xy), CLUSTER_COUNTS.xy - 1);
+    int slice = clamp(int(log(ViewDepth) * clusterParams.z + clusterParams.w), 0, CLUSTER_COUNTS.z - 1);
+    uvec2 range = texelFetch(clusterGrid, (slice * CLUSTER_COUNTS.y + tile.y) * CLUSTER_COUNTS.x + tile.x).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec4 colorIntensity = texelFetch(lightData, light * 2 + 1);
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float distance = length(toLight);
+        if (distance >= positionRadius.w) {
+            continue;
+        }
+        vec3 lightDir = toLight / distance;
+        // Smooth falloff that reaches zero at the light's radius
+        float falloff = 1.0 - distance / positionRadius.w;
+        falloff *= falloff;
+        float diff = max(dot(norm, lightDir), 0.0);
+        float spec = 0.5 * pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), 32);
+        result += (diff + spec) * falloff * colorIntensity.rgb * colorIntensity.w;
+    }
+    return result;
+}
+
+// How much of the scene light reaches the fragment, from 3x3 filtered lookups into the shadow map
+float shadowFactor()
+{
+    // Fragments behind the light or past the map are lit
+    if (LightSpacePos.w <= 0.0) {
+        return 1.0;
+    }
+    vec3 coords = LightSpacePos.xyz / LightSpacePos.w * 0.5 + 0.5;
+    if (coords.z > 1.0) {
+        return 1.0;
+    }
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowMap, vec3(coords.xy + vec2(x, y) * texel, coords.z));
+        }
+    }
+    return lit / 9.0;
+}
 
 void main()
 {
+    // Pick the material source for this draw
+    DrawRecord draw = draws[DrawIndex];
+    bool instanced = draw.drawFlags.x != 0;
+    vec3 color = instanced ? InstanceColor.rgb : draw.objectColor.rgb;
+    float alpha = instanced ? InstanceColor.a : draw.objectColor.a;
+    bool textured = instanced ? InstanceParams.x >= 0.0 : draw.drawFlags.y != 0;
+    bool bright = instanced ? InstanceParams.y > 0.5 : draw.drawFlags.z != 0;
+
     // Ambient lighting
     float ambientStrength = 0.2;
-    if (brighter) {
+    if (bright) {
         ambientStrength = 0.4;
     }
     vec3 ambient = ambientStrength * lightColor;
@@ -38,21 +128,36 @@ void main()
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     vec3 specular = specularStrength * spec * lightColor;  
 
+    // Shadows of the scene light
+    float shadow = shadowFactor();
+    diffuse *= shadow;
+    specular *= shadow;
+
+    // Point lights near the fragment
+    vec3 points = reflectionPass ? vec3(0.0) : clusterLighting(norm, viewDir);
+
     // Combine the lighting effects
     vec3 finalColor;
-    if (useTexture) {
+    if (textured) {
         // Check if texture coordinates are 0.0f
         if (TexCoord.x == 0.0f && TexCoord.y == 1.0f) {
             // Set fragment color to a solid color
-            finalColor = (ambient + diffuse + specular) * objectColor;
+            finalColor = (ambient + diffuse + specular + points) * color;
         } else {
-            vec3 texColor = texture(texture1, TexCoord).rgb;
-            finalColor = (ambient + diffuse + specular) * texColor;
+            vec3 texColor = instanced ? texture(textureArray, vec3(TexCoord, InstanceParams.x)).rgb
+                                      : texture(texture1, draw.uvRect.xy + TexCoord * draw.uvRect.zw).rgb;
+            finalColor = (ambient + diffuse + specular + points) * texColor;
         }
     } else {
-        finalColor = (ambient + diffuse + specular) * (objectColor);
+        finalColor = (ambient + diffuse + specular + points) * (color);
+    }
+
+    // Glossy surfaces show the planar reflection over their own color
+    if (draw.drawFlags.w != 0) {
+        vec3 mirrored = texture(reflectionMap, gl_FragCoord.xy / viewportSize).rgb;
+        finalColor = mix(finalColor, mirrored, 0.3);
     }
 
     // Output the final color with the appropriate alpha
-    FragColor = vec4(finalColor, objectAlpha);
-}
+    FragColor = vec4(finalColor, alpha);
+}
\ No newline at end of file
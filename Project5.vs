@@ -2,21 +2,58 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 texCoord;
+// Per-instance attributes, only used by instanced draws
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in vec4 instanceColor;
+layout (location = 8) in vec2 instanceParams;
+layout (location = 9) in mat3 instanceNormalMatrix;
+// Which record of the DrawData window this draw uses, from a multi-draw's base instance or set per draw
+layout (location = 12) in uint drawIndex;
 
 out vec2 TexCoord;
 
 out vec3 FragPos;
 out vec3 Normal;
+out vec4 InstanceColor;
+flat out vec2 InstanceParams;
+flat out uint DrawIndex;
+out float ViewDepth;
+out vec4 LightSpacePos;
 
-uniform mat4 model;
+// Per-draw data, one record per draw in the render queue's draw ring (DrawRing.h)
+struct DrawRecord {
+    mat4 model;
+    mat3 normalMatrix;  // Inverse transpose of model, computed once on the CPU
+    vec4 objectColor;   // rgb and alpha
+    ivec4 drawFlags;    // instanced, useTexture, brighter, mirror
+    vec4 uvRect;        // Offset and scale of TexCoord into the texture, the object's region of an atlas
+};
+// The window of the ring the current draws read, DrawRing::RECORDS_PER_WINDOW long
+layout (std140) uniform DrawData {
+    DrawRecord draws[102];
+};
 uniform mat4 view;
 uniform mat4 projection;
+// Projection and view of the scene light's shadow map
+uniform mat4 lightSpace;
+// Plane the planar reflection is clipped against, only enabled while the reflection is drawn
+uniform vec4 clipPlane;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    DrawRecord draw = draws[drawIndex];
+    bool instanced = draw.drawFlags.x != 0;
+    mat4 world = instanced ? instanceModel : draw.model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal = (instanced ? instanceNormalMatrix : draw.normalMatrix) * aNormal;
+    InstanceColor = instanceColor;
+    InstanceParams = instanceParams;
+    DrawIndex = drawIndex;
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    vec4 viewPosition = view * vec4(FragPos, 1.0);
+    ViewDepth = -viewPosition.z;
+    LightSpacePos = lightSpace * vec4(FragPos, 1.0);
+    gl_ClipDistance[0] = dot(vec4(FragPos, 1.0), clipPlane);
+    gl_Position = projection * viewPosition;
     TexCoord = vec2(texCoord.x, 1.0 - texCoord.y);
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*Redraw tracker class*/
+
+#ifndef REDRAW_TRACKER_H
+#define REDRAW_TRACKER_H
+
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Tells the main loop whether the window still shows the current scene, so a static scene is only drawn when
+// something changes. A frame is needed when the camera, the scene light or an object moved since the last drawn
+// frame. When the window system only asks for the window to be repainted, the last drawn frame is kept in a
+// renderbuffer and shown again without drawing the scene. The rest of the time the loop can sleep in
+// glfwWaitEvents.
+class RedrawTracker {
+public:
+    // Draws only on changes when set, with --on-demand
+    bool enabled = false;
+
+    // Makes the renderbuffer the last frame of a width x height window is kept in
+    void create(int width, int height) {
+        if (!enabled) {
+            return;
+        }
+        this->width = width;
+        this->height = height;
+        glGenRenderbuffers(1, &renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR::REDRAW::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // The window has to be repainted, called from the window refresh callback
+    void expose() {
+        exposed = true;
+    }
+
+    // Forces the next frame to be drawn
+    void invalidate() {
+        dirty = true;
+    }
+
+    // Whether the scene has to be drawn because the view, the light or sceneVersion (any number that changes
+    // whenever an object moves) differs from the last drawn frame. Remembers them as drawn when it does.
+    bool changed(const glm::mat4& view, const glm::vec3& lightPos, unsigned long sceneVersion) {
+        if (!dirty && view == drawnView && lightPos == drawnLight && sceneVersion == drawnVersion) {
+            return false;
+        }
+        dirty = false;
+        exposed = false;
+        drawnView = view;
+        drawnLight = lightPos;
+        drawnVersion = sceneVersion;
+        drawn++;
+        return true;
+    }
+
+    // Whether the window asked to be repainted since the last frame was drawn or shown, and clears the request
+    bool takeExposed() {
+        bool wasExposed = exposed;
+        exposed = false;
+        return wasExposed;
+    }
+
+    // Keeps a copy of the frame just drawn into the window's back buffer
+    void store() {
+        if (framebuffer == 0) {
+            return;
+        }
+        blit(0, framebuffer);
+    }
+
+    // Copies the kept frame back into the window's back buffer, swap the buffers afterwards
+    void present() {
+        blit(framebuffer, 0);
+        presented++;
+    }
+
+    // Counts a sleep in glfwWaitEvents
+    void waited() {
+        waits++;
+    }
+
+    // Prints how many frames were drawn and shown again
+    void report() const {
+        if (enabled) {
+            std::cout << "On-demand redraw: " << drawn << " frames drawn, " << presented << " shown again, "
+                      << waits << " waits for events" << std::endl;
+        }
+    }
+
+    void destroy() {
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &renderbuffer);
+            framebuffer = renderbuffer = 0;
+        }
+    }
+
+private:
+    GLuint framebuffer = 0, renderbuffer = 0;
+    int width = 0, height = 0;
+    bool dirty = true, exposed = false;
+    glm::mat4 drawnView = glm::mat4(1.0f);
+    glm::vec3 drawnLight = glm::vec3(0.0f);
+    unsigned long drawnVersion = 0;
+    long drawn = 0, presented = 0, waits = 0;
+
+    void blit(GLuint from, GLuint to) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,298 @@
+/*Render queue class*/
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <tuple>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "GeometryRegistry.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include "DrawRing.h"
+
+// Everything needed to issue one draw call
+struct DrawItem {
+    // State
+    GLuint program = 0;
+    GLuint VAO = 0;
+    GLuint texture = 0;             // 0 for untextured draws
+    GLenum textureTarget = GL_TEXTURE_2D;
+    // Draw call, every shape is indexed and lives in the geometry registry's shared buffers
+    GLsizei count = 0;              // Indices
+    GLuint firstIndex = 0;
+    GLint baseVertex = 0;
+    GLsizei instanceCount = 0;      // Greater than 0 for instanced groups
+    // Per-draw data written to the draw ring, instanced draws read it from their instance buffer instead
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(1.0f);
+    glm::vec4 color = glm::vec4(1.0f);
+    bool brighter = false;
+    // Shows the planar reflection on top of the draw's own color
+    bool mirror = false;
+    // Region of texture the draw samples, the whole texture unless it is an atlas
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    // Sorting
+    bool transparent = false;
+    float viewDepth = 0.0f;
+    // Name the profiler times the draw's GPU work under
+    const char* group = nullptr;
+    // Index of the draw's DrawRecord in this frame's part of the draw ring, set by flush()
+    uint32_t record = 0;
+};
+
+// Layout glMultiDrawElementsIndirect reads its commands in
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Collects the draws of a frame, then issues opaque draws sorted by state and transparent draws back to front.
+// Consecutive draws through the geometry registry's shared VAO that share a program and texture go out as
+// one glMultiDrawElementsIndirect call where the driver supports it.
+class RenderQueue {
+public:
+    // Times each run of draws from the same group on the GPU when set
+    Profiler* profiler = nullptr;
+    // Sorts the opaque and transparent draws at the same time when set
+    JobSystem* jobs = nullptr;
+
+    // Starts a new frame seen through the given view matrix
+    void begin(const glm::mat4& view) {
+        this->view = view;
+        opaque.clear();
+        transparent.clear();
+    }
+
+    void submit(const DrawItem& item) {
+        if (item.transparent) {
+            DrawItem sorted = item;
+            // Depth of the object's origin along the view direction
+            sorted.viewDepth = (view * sorted.model[3]).z;
+            transparent.push_back(sorted);
+        } else {
+            opaque.push_back(item);
+        }
+    }
+
+    // Sorts and issues every queued draw
+    void flush(GeometryRegistry& registry) {
+        if (jobs) {
+            JobGroup sorting;
+            jobs->run(sorting, [this] { sortOpaque(); });
+            sortTransparent();
+            jobs->wait(sorting);
+        } else {
+            sortOpaque();
+            sortTransparent();
+        }
+
+        // Write every draw's record up front so the whole frame reaches the GPU at once
+        ring.beginFrame(opaque.size() + transparent.size());
+        for (auto* items : { &opaque, &transparent }) {
+            for (auto& item : *items) {
+                item.record = ring.push(DrawRecord(item.model, item.normalMatrix, item.color, item.instanceCount > 0,
+                                                   item.texture != 0 && item.textureTarget == GL_TEXTURE_2D, item.brighter,
+                                                   item.mirror, item.uvRect));
+            }
+        }
+        ring.upload();
+
+        // Split the draws into API calls and upload every multi-draw command of the frame at once
+        calls.clear();
+        commands.clear();
+        plan(opaque, false, registry);
+        plan(transparent, true, registry);
+        if (!commands.empty()) {
+            if (indirectBuffer == 0) {
+                glGenBuffers(1, &indirectBuffer);
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            // Orphan last frame's commands rather than wait for the GPU to finish with them
+            GLsizeiptr size = (GLsizeiptr)(commands.size() * sizeof(DrawElementsIndirectCommand));
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, size, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, commands.data());
+        }
+
+        stateChanges = 0;
+        draws = 0;
+        apiCalls = 0;
+        currentProgram = 0;
+        currentTexture = 0;
+        currentArrayTexture = 0;
+        currentVAO = 0;
+        currentGroup = nullptr;
+
+        bool depthWrites = true;
+        for (const auto& call : calls) {
+            // Transparent surfaces are tested against the depth buffer but do not hide what is behind them
+            if (call.transparent && depthWrites) {
+                glDepthMask(GL_FALSE);
+                depthWrites = false;
+            }
+            execute(call, registry);
+        }
+        glDepthMask(GL_TRUE);
+        ring.endFrame();
+        if (profiler) {
+            profiler->endGpu();
+        }
+
+        frames++;
+        totalStateChanges += stateChanges;
+        totalDraws += draws;
+        totalApiCalls += apiCalls;
+    }
+
+    // State changes, objects drawn and draw calls issued by the last flush
+    long stateChanges = 0, draws = 0, apiCalls = 0;
+
+    // Prints the average number of state changes and draws per frame
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Render queue: " << (double)totalStateChanges / frames << " state changes and "
+                      << (double)totalDraws / frames << " draws in " << (double)totalApiCalls / frames
+                      << " draw calls per frame" << std::endl;
+        }
+        ring.report();
+    }
+
+    void destroy() {
+        ring.destroy();
+        if (indirectBuffer != 0) {
+            glDeleteBuffers(1, &indirectBuffer);
+            indirectBuffer = 0;
+        }
+    }
+
+private:
+    glm::mat4 view = glm::mat4(1.0f);
+    std::vector<DrawItem> opaque, transparent;
+    DrawRing ring;
+    GLuint currentProgram = 0, currentTexture = 0, currentArrayTexture = 0, currentVAO = 0;
+    const char* currentGroup = nullptr;
+    long frames = 0, totalStateChanges = 0, totalDraws = 0, totalApiCalls = 0;
+
+    // One API call: count draws starting at first, issued as one multi-draw when command is not NO_COMMAND
+    struct Call {
+        const DrawItem* first;
+        size_t count;
+        size_t command;
+        bool transparent;
+    };
+    static const size_t NO_COMMAND = SIZE_MAX;
+    std::vector<Call> calls;
+    std::vector<DrawElementsIndirectCommand> commands;
+    GLuint indirectBuffer = 0;
+
+    // Groups opaque draws so the program, then the texture, then the VAO change as rarely as possible
+    void sortOpaque() {
+        std::stable_sort(opaque.begin(), opaque.end(), [](const DrawItem& a, const DrawItem& b) {
+            return std::tie(a.program, a.textureTarget, a.texture, a.VAO) <
+                   std::tie(b.program, b.textureTarget, b.texture, b.VAO);
+        });
+    }
+
+    // Transparent draws blend from the farthest to the nearest, view space looks down -z
+    void sortTransparent() {
+        std::stable_sort(transparent.begin(), transparent.end(), [](const DrawItem& a, const DrawItem& b) {
+            return a.viewDepth < b.viewDepth;
+        });
+    }
+
+    // Whether a draw can go into a multi-draw call
+    static bool multiDrawable(const DrawItem& item, const GeometryRegistry& registry) {
+        return registry.multiDraw && item.VAO == registry.VAO && item.instanceCount == 0;
+    }
+
+    // Splits items into calls. A multi-draw keeps going while the program, texture and profiled group stay
+    // the same and the records still fit the draw ring window of its first draw.
+    void plan(const std::vector<DrawItem>& items, bool transparent, const GeometryRegistry& registry) {
+        for (size_t begin = 0; begin < items.size(); ) {
+            const DrawItem& first = items[begin];
+            Call call = { &first, 1, NO_COMMAND, transparent };
+            if (multiDrawable(first, registry)) {
+                size_t window = ring.windowOf(first.record);
+                while (begin + call.count < items.size()) {
+                    const DrawItem& next = items[begin + call.count];
+                    if (!multiDrawable(next, registry) || next.program != first.program ||
+                        next.texture != first.texture || next.textureTarget != first.textureTarget ||
+                        (profiler && next.group != first.group) || next.record >= window + DrawRing::RECORDS_PER_WINDOW) {
+                        break;
+                    }
+                    call.count++;
+                }
+                call.command = commands.size();
+                for (size_t i = begin; i < begin + call.count; i++) {
+                    // The base instance picks the draw index out of the registry's draw index buffer
+                    DrawElementsIndirectCommand command = { (GLuint)items[i].count, 1, items[i].firstIndex,
+                                                            items[i].baseVertex, (GLuint)(items[i].record - window) };
+                    commands.push_back(command);
+                }
+            }
+            calls.push_back(call);
+            begin += call.count;
+        }
+    }
+
+    void execute(const Call& call, GeometryRegistry& registry) {
+        const DrawItem& item = *call.first;
+        // Sorting can split a group into several runs, the profiler adds them up
+        if (profiler && (item.group != currentGroup || apiCalls == 0)) {
+            profiler->beginGpu(item.group ? item.group : "Ungrouped");
+            currentGroup = item.group;
+        }
+        if (item.program != currentProgram) {
+            glUseProgram(item.program);
+            currentProgram = item.program;
+            stateChanges++;
+        }
+        // 2D textures live on unit 0 and texture arrays on unit 1
+        if (item.texture != 0) {
+            GLuint& bound = item.textureTarget == GL_TEXTURE_2D_ARRAY ? currentArrayTexture : currentTexture;
+            if (item.texture != bound) {
+                glActiveTexture(item.textureTarget == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE1 : GL_TEXTURE0);
+                glBindTexture(item.textureTarget, item.texture);
+                glActiveTexture(GL_TEXTURE0);
+                bound = item.texture;
+                stateChanges++;
+            }
+        }
+        if (item.VAO != currentVAO) {
+            currentVAO = item.VAO;
+            stateChanges++;
+        }
+        registry.bindVertexArray(item.VAO);
+
+        size_t window = ring.windowOf(item.record);
+        ring.bindWindow(window);
+        if (call.command != NO_COMMAND) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        (const GLvoid*)(call.command * sizeof(DrawElementsIndirectCommand)), (GLsizei)call.count, 0);
+        } else {
+            // Draws outside the shared VAO read the draw index from the attribute's current value
+            glVertexAttribI1ui(GeometryRegistry::DRAW_INDEX_ATTRIBUTE, (GLuint)(item.record - window));
+            const GLvoid* indices = (const GLvoid*)(item.firstIndex * sizeof(GLuint));
+            if (item.instanceCount > 0) {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, indices, item.instanceCount, item.baseVertex);
+            } else {
+                glDrawElementsBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, indices, item.baseVertex);
+            }
+        }
+        draws += (long)call.count;
+        apiCalls++;
+    }
+};
+
+#endif
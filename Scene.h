@@ -0,0 +1,301 @@
+/*Scene file classes*/
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Primitive an object in the scene is built from
+enum SceneObjectType : uint32_t {
+    SCENE_CUBE,
+    SCENE_GAME,
+    SCENE_TRAPEZOID,
+    SCENE_PYRAMID,
+    SCENE_TOWEL,
+    SCENE_LIGHT             // Small point light, scale holds its radius and color its rgb and intensity
+};
+
+// Flags of a scene object
+enum SceneObjectFlags : uint32_t {
+    SCENE_OCCLUDER = 1,     // Rasterized into the occlusion buffer to hide what is behind it
+    SCENE_ATLAS = 2,        // The object's texture is packed into the shared texture atlas
+    SCENE_DYNAMIC = 4,      // May move, so its shadow is drawn every frame instead of into the cached shadow map
+    SCENE_MIRROR = 8        // The front (+z) face of the cube shows a planar reflection of the scene
+};
+
+// Start of a baked scene, followed by objectCount records and then stringBytes of null terminated strings
+struct SceneHeader {
+    char magic[4];          // "SCN1"
+    uint32_t version;
+    uint32_t objectCount;
+    uint32_t stringBytes;
+};
+
+// One object of a baked scene, laid out exactly as it is stored on disk
+struct SceneRecord {
+    uint32_t type;          // SceneObjectType
+    uint32_t group;         // Offset of the group name in the string table
+    uint32_t path;          // Offset of the texture or model path, NO_STRING if there is none
+    uint32_t flags;         // SceneObjectFlags
+    float position[3];      // Meters
+    float scale[3];         // Meters
+    float angle[3];         // Degrees around x, y and z
+    float color[4];         // RGBA
+};
+
+// Turns a text scene description into a baked binary scene.
+//
+// Every non-empty line that does not start with # describes one object:
+//   <cube|game|trapezoid|pyramid|towel|light> <group> [position x y z] [scale x y z] [angle x y z] [color r g b a] [radius r]
+//   [texture path] [model path] [occluder] [atlas] [dynamic] [mirror]
+// Lengths are in meters unless they end in "in" (inches) or "ft" (feet). radius sets all three scales, lights use it
+// as their range and the alpha of their color as their intensity.
+class SceneCompiler {
+public:
+    static const uint32_t VERSION = 6;
+    static const uint32_t NO_STRING = 0xFFFFFFFF;
+
+    // Parses textPath and writes the baked scene to binaryPath
+    static bool compile(const std::string& textPath, const std::string& binaryPath) {
+        std::ifstream text(textPath);
+        if (!text) {
+            std::cerr << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ " << textPath << std::endl;
+            return false;
+        }
+
+        std::vector<SceneRecord> records;
+        std::string strings;
+        std::map<std::string, uint32_t> offsets;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(text, line)) {
+            lineNumber++;
+            std::istringstream tokens(line);
+            std::string type, group;
+            if (!(tokens >> type) || type[0] == '#') {
+                continue;
+            }
+
+            SceneRecord record;
+            if (!parseType(type, record.type) || !(tokens >> group)) {
+                std::cerr << "ERROR::SCENE::BAD_OBJECT " << textPath << ":" << lineNumber << std::endl;
+                return false;
+            }
+            record.group = intern(group, strings, offsets);
+            record.path = NO_STRING;
+            record.flags = 0;
+            setAll(record.position, 3, 0.0f);
+            setAll(record.scale, 3, 1.0f);
+            setAll(record.angle, 3, 0.0f);
+            setAll(record.color, 4, 1.0f);
+
+            std::string field;
+            bool ok = true;
+            while (ok && tokens >> field) {
+                if (field == "position") {
+                    ok = readLengths(tokens, record.position, 3);
+                } else if (field == "scale") {
+                    ok = readLengths(tokens, record.scale, 3);
+                } else if (field == "angle") {
+                    ok = readNumbers(tokens, record.angle, 3);
+                } else if (field == "color") {
+                    ok = readNumbers(tokens, record.color, 4);
+                } else if (field == "radius") {
+                    ok = readLengths(tokens, record.scale, 1);
+                    setAll(record.scale + 1, 2, record.scale[0]);
+                } else if (field == "occluder") {
+                    record.flags |= SCENE_OCCLUDER;
+                } else if (field == "atlas") {
+                    record.flags |= SCENE_ATLAS;
+                } else if (field == "dynamic") {
+                    record.flags |= SCENE_DYNAMIC;
+                } else if (field == "mirror") {
+                    record.flags |= SCENE_MIRROR;
+                } else if (field == "texture" || field == "model") {
+                    std::string path;
+                    ok = (bool)(tokens >> path);
+                    record.path = intern(path, strings, offsets);
+                } else {
+                    ok = false;
+                }
+            }
+            if (!ok) {
+                std::cerr << "ERROR::SCENE::BAD_FIELD " << field << " at " << textPath << ":" << lineNumber << std::endl;
+                return false;
+            }
+            records.push_back(record);
+        }
+
+        SceneHeader header;
+        std::memcpy(header.magic, "SCN1", 4);
+        header.version = VERSION;
+        header.objectCount = (uint32_t)records.size();
+        header.stringBytes = (uint32_t)strings.size();
+
+        std::ofstream binary(binaryPath, std::ios::binary | std::ios::trunc);
+        binary.write((const char*)&header, sizeof(header));
+        binary.write((const char*)records.data(), records.size() * sizeof(SceneRecord));
+        binary.write(strings.data(), strings.size());
+        if (!binary) {
+            std::cerr << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_WRITTEN " << binaryPath << std::endl;
+            return false;
+        }
+        std::cout << "Compiled scene: " << textPath << " -> " << binaryPath << " (" << records.size() << " objects)" << std::endl;
+        return true;
+    }
+
+private:
+    static bool parseType(const std::string& name, uint32_t& type) {
+        static const char* names[] = { "cube", "game", "trapezoid", "pyramid", "towel", "light" };
+        for (uint32_t i = 0; i < 6; i++) {
+            if (name == names[i]) {
+                type = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Stores each distinct string once and returns its offset
+    static uint32_t intern(const std::string& value, std::string& strings, std::map<std::string, uint32_t>& offsets) {
+        auto found = offsets.find(value);
+        if (found != offsets.end()) {
+            return found->second;
+        }
+        uint32_t offset = (uint32_t)strings.size();
+        strings += value;
+        strings += '\0';
+        offsets[value] = offset;
+        return offset;
+    }
+
+    static void setAll(float* values, int count, float value) {
+        for (int i = 0; i < count; i++) {
+            values[i] = value;
+        }
+    }
+
+    static bool readNumbers(std::istringstream& tokens, float* values, int count) {
+        for (int i = 0; i < count; i++) {
+            if (!(tokens >> values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Reads lengths that may end in "in" or "ft" and converts them to meters
+    static bool readLengths(std::istringstream& tokens, float* values, int count) {
+        for (int i = 0; i < count; i++) {
+            std::string token;
+            if (!(tokens >> token)) {
+                return false;
+            }
+            char* end;
+            float value = std::strtof(token.c_str(), &end);
+            std::string unit(end);
+            if (end == token.c_str()) {
+                return false;
+            } else if (unit == "in") {
+                value *= 0.0254f;
+            } else if (unit == "ft") {
+                value *= 0.3048f;
+            } else if (!unit.empty()) {
+                return false;
+            }
+            values[i] = value;
+        }
+        return true;
+    }
+};
+
+// A baked scene mapped straight into memory, records are read in place without parsing
+class SceneFile {
+public:
+    // Maps the baked scene at path, returns false if it is missing or not a valid scene
+    bool open(const std::string& path) {
+        close();
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size >= (off_t)sizeof(SceneHeader)) {
+            size = (size_t)info.st_size;
+            void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+            data = mapped == MAP_FAILED ? NULL : (const char*)mapped;
+        }
+        ::close(file);
+        if (!data) {
+            return false;
+        }
+
+        const SceneHeader* header = (const SceneHeader*)data;
+        size_t expected = sizeof(SceneHeader) + (size_t)header->objectCount * sizeof(SceneRecord) + header->stringBytes;
+        if (std::memcmp(header->magic, "SCN1", 4) != 0 || header->version != SceneCompiler::VERSION || expected != size) {
+            std::cerr << "ERROR::SCENE::INVALID_BINARY " << path << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Opens the baked scene next to textPath, compiling it first if it is missing or older than the text
+    bool openCompiled(const std::string& textPath) {
+        std::string binaryPath = textPath.substr(0, textPath.find_last_of('.')) + ".bin";
+        struct stat textInfo, binaryInfo;
+        bool stale = stat(binaryPath.c_str(), &binaryInfo) != 0 ||
+                     (stat(textPath.c_str(), &textInfo) == 0 && textInfo.st_mtime > binaryInfo.st_mtime);
+        if (stale && !SceneCompiler::compile(textPath, binaryPath)) {
+            return false;
+        }
+        if (open(binaryPath)) {
+            return true;
+        }
+        // The binary may come from an older version of the format
+        return SceneCompiler::compile(textPath, binaryPath) && open(binaryPath);
+    }
+
+    size_t count() const {
+        return data ? ((const SceneHeader*)data)->objectCount : 0;
+    }
+
+    const SceneRecord& operator[](size_t index) const {
+        return ((const SceneRecord*)(data + sizeof(SceneHeader)))[index];
+    }
+
+    // Returns a string of the string table, or nullptr for NO_STRING
+    const char* string(uint32_t offset) const {
+        if (offset == SceneCompiler::NO_STRING) {
+            return nullptr;
+        }
+        return data + sizeof(SceneHeader) + count() * sizeof(SceneRecord) + offset;
+    }
+
+    void close() {
+        if (data) {
+            munmap((void*)data, size);
+        }
+        data = NULL;
+        size = 0;
+    }
+
+private:
+    const char* data = NULL;
+    size_t size = 0;
+};
+
+#endif
@@ -0,0 +1,16 @@
+// Bakes a text scene description into the binary scene Project5 maps at startup
+#include <iostream>
+#include <string>
+
+#include "Scene.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <scene.txt> [scene.bin]" << std::endl;
+        return 1;
+    }
+    std::string textPath = argv[1];
+    std::string binaryPath = argc > 2 ? argv[2] : textPath.substr(0, textPath.find_last_of('.')) + ".bin";
+    return SceneCompiler::compile(textPath, binaryPath) ? 0 : 1;
+}
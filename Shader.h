@@ -7,9 +7,16 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <unordered_map>
 
 #include <GL/glew.h>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ProgramCache.h"
+
 class Shader
 {
 public:
@@ -45,9 +52,23 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        // 2. Reuse the program an earlier run linked, as long as the driver still accepts it
+        bool cacheable = ProgramCache::supported();
+        uint64_t key = cacheable ? ProgramCache::keyOf(vertexCode, fragmentCode) : 0;
+        if (cacheable)
+        {
+            this->Program = glCreateProgram();
+            if (ProgramCache::load(key, this->Program))
+            {
+                std::cout << "Loaded cached shader program: " << vertexPath << ", " << fragmentPath << std::endl;
+                reflectUniforms();
+                return;
+            }
+            glDeleteProgram(this->Program);
+        }
         const GLchar* vShaderCode = vertexCode.c_str();
         const GLchar * fShaderCode = fragmentCode.c_str();
-        // 2. Compile shaders
+        // 3. Compile shaders
         GLuint vertex, fragment;
         GLint success;
         GLchar infoLog[512];
@@ -77,6 +98,9 @@ public:
         this->Program = glCreateProgram();
         glAttachShader(this->Program, vertex);
         glAttachShader(this->Program, fragment);
+        // Ask the driver to keep a binary it can hand back for the cache
+        if (cacheable)
+            glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(this->Program);
         // Print linking errors if any
         glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
@@ -85,16 +109,138 @@ public:
             glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
             std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
         }
+        else if (cacheable)
+        {
+            ProgramCache::store(key, this->Program);
+        }
         // Delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
 
+        // 4. Cache the location and type of every active uniform
+        reflectUniforms();
     }
     // Uses the current shader
     void Use() 
     { 
         glUseProgram(this->Program); 
     }
+
+    // Returns the cached location of a uniform, -1 if the program does not use it
+    GLint uniformLocation(const std::string& name) const
+    {
+        auto found = uniforms.find(name);
+        return found != uniforms.end() ? found->second.location : -1;
+    }
+
+    // Typed setters, the program must be in use. An upload is skipped when the uniform already holds the value.
+    void setBool(const std::string& name, bool value)
+    {
+        setInt(name, value ? 1 : 0);
+    }
+    void setInt(const std::string& name, GLint value)
+    {
+        UniformInfo* uniform = changed(name, &value, sizeof(value));
+        if (uniform)
+            glUniform1i(uniform->location, value);
+    }
+    void setFloat(const std::string& name, GLfloat value)
+    {
+        UniformInfo* uniform = changed(name, &value, sizeof(value));
+        if (uniform)
+            glUniform1f(uniform->location, value);
+    }
+    void setVec2(const std::string& name, const glm::vec2& value)
+    {
+        UniformInfo* uniform = changed(name, glm::value_ptr(value), sizeof(GLfloat) * 2);
+        if (uniform)
+            glUniform2fv(uniform->location, 1, glm::value_ptr(value));
+    }
+    void setVec3(const std::string& name, const glm::vec3& value)
+    {
+        UniformInfo* uniform = changed(name, glm::value_ptr(value), sizeof(GLfloat) * 3);
+        if (uniform)
+            glUniform3fv(uniform->location, 1, glm::value_ptr(value));
+    }
+    void setVec4(const std::string& name, const glm::vec4& value)
+    {
+        UniformInfo* uniform = changed(name, glm::value_ptr(value), sizeof(GLfloat) * 4);
+        if (uniform)
+            glUniform4fv(uniform->location, 1, glm::value_ptr(value));
+    }
+    void setMat3(const std::string& name, const glm::mat3& value)
+    {
+        UniformInfo* uniform = changed(name, glm::value_ptr(value), sizeof(GLfloat) * 9);
+        if (uniform)
+            glUniformMatrix3fv(uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+    void setMat4(const std::string& name, const glm::mat4& value)
+    {
+        UniformInfo* uniform = changed(name, glm::value_ptr(value), sizeof(GLfloat) * 16);
+        if (uniform)
+            glUniformMatrix4fv(uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    // Connects a uniform block of the program to a uniform buffer binding point
+    void bindUniformBlock(const std::string& name, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(this->Program, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(this->Program, index, binding);
+    }
+
+private:
+    // What the program reported for a uniform plus the last value uploaded to it
+    struct UniformInfo
+    {
+        GLint location;
+        GLenum type;
+        GLint size;
+        bool hasValue;
+        unsigned char value[sizeof(GLfloat) * 16];
+    };
+    std::unordered_map<std::string, UniformInfo> uniforms;
+
+    // Enumerates the active uniforms of the linked program
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            UniformInfo info;
+            glGetActiveUniform(this->Program, (GLuint)i, maxLength, &length, &info.size, &info.type, &name[0]);
+            std::string uniformName(name.c_str(), length);
+            info.location = glGetUniformLocation(this->Program, uniformName.c_str());
+            // Members of uniform blocks have no location
+            if (info.location < 0)
+                continue;
+            info.hasValue = false;
+            // Arrays are reported as "name[0]", store them under their plain name as well
+            size_t bracket = uniformName.find('[');
+            if (bracket != std::string::npos)
+                uniforms[uniformName.substr(0, bracket)] = info;
+            uniforms[uniformName] = info;
+        }
+    }
+
+    // Returns the uniform if it exists and the value differs from the cached one, updating the cache
+    UniformInfo* changed(const std::string& name, const void* value, size_t bytes)
+    {
+        auto found = uniforms.find(name);
+        if (found == uniforms.end())
+            return nullptr;
+        UniformInfo& uniform = found->second;
+        if (uniform.hasValue && std::memcmp(uniform.value, value, bytes) == 0)
+            return nullptr;
+        std::memcpy(uniform.value, value, bytes);
+        uniform.hasValue = true;
+        return &uniform;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,6 @@
+#version 330 core
+
+// Shadow casters only write depth, the shadow map has no color attachment
+void main()
+{
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// Which record of the DrawData window this draw uses, as in Project5.vs
+layout (location = 12) in uint drawIndex;
+
+// Per-draw data from the shadow queue's draw ring, laid out like Project5.vs but only the model matrix is read
+struct DrawRecord {
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 objectColor;
+    ivec4 drawFlags;
+    vec4 uvRect;
+};
+layout (std140) uniform DrawData {
+    DrawRecord draws[102];
+};
+// Projection and view of the scene light (ShadowMap.h)
+uniform mat4 lightSpace;
+
+void main()
+{
+    gl_Position = lightSpace * draws[drawIndex].model * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,224 @@
+/*Shadow map class*/
+
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "AABB.h"
+
+// Shadow map of the scene light that is only redrawn when something it shows moves. The static casters are
+// drawn into their own depth texture once and kept until the light moves or one of them does. Dynamic casters
+// are drawn every frame into a second texture that starts out as a copy of the static one. Only the part of it
+// the dynamic casters covered last frame or cover now is copied and drawn into, so that pass stays small.
+class ShadowMap {
+public:
+    // Texture unit of the shadowMap sampler
+    static const GLint UNIT = 5;
+    static const int SIZE = 2048;
+
+    // Projection and view of the light, for the lightSpace uniforms
+    glm::mat4 lightSpace = glm::mat4(1.0f);
+
+    // Aims the light at the scene so all of it is inside the map. Returns whether the static casters have to
+    // be drawn again: the map is new, the light moved or casterVersion (any number that changes whenever a
+    // static caster moves) changed since they were last drawn.
+    bool update(const glm::vec3& lightPos, const AABB& scene, unsigned long casterVersion) {
+        frames++;
+        if (framebuffers[0] != 0 && lightPos == cachedLight && casterVersion == cachedVersion) {
+            return false;
+        }
+        if (framebuffers[0] == 0) {
+            create();
+        }
+        cachedLight = lightPos;
+        cachedVersion = casterVersion;
+        fit(lightPos, scene);
+        staticDraws++;
+        return true;
+    }
+
+    // Starts drawing the static casters into the cleared static map
+    void beginStatic() {
+        begin(0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        // The dynamic map has to be copied again in full
+        previous = Rect{ 0, 0, SIZE, SIZE };
+    }
+
+    // Starts drawing the dynamic casters, whose world space bounds are casters, over a copy of the static map
+    void beginDynamic(const AABB& casters) {
+        Rect covered = project(casters);
+        // Copy back what last frame's casters darkened as well as the area the casters are drawn into now
+        Rect copied = merge(covered, previous);
+        previous = covered;
+
+        begin(1);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+        glBlitFramebuffer(copied.x0, copied.y0, copied.x1, copied.y1, copied.x0, copied.y0, copied.x1, copied.y1,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(copied.x0, copied.y0, copied.x1 - copied.x0, copied.y1 - copied.y0);
+        dynamicDraws++;
+        copiedTexels += (long)(copied.x1 - copied.x0) * (copied.y1 - copied.y0);
+    }
+
+    // Finishes a pass and goes back to the framebuffer and viewport from before it
+    void end() {
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, savedDraw);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, savedRead);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // Binds the map the scene samples, the dynamic one when dynamic casters were drawn this frame
+    void bind(bool dynamic) const {
+        glActiveTexture(GL_TEXTURE0 + UNIT);
+        glBindTexture(GL_TEXTURE_2D, textures[dynamic ? 1 : 0]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Prints how often the static map was redrawn and how much the dynamic pass copied
+    void report() const {
+        if (frames > 0) {
+            std::cout << "Shadow map: static casters drawn in " << staticDraws << " of " << frames << " frames";
+            if (dynamicDraws > 0) {
+                std::cout << ", dynamic pass copied " << 100.0 * copiedTexels / dynamicDraws / ((double)SIZE * SIZE)
+                          << "% of the map per frame on average";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    void destroy() {
+        if (framebuffers[0] != 0) {
+            glDeleteFramebuffers(2, framebuffers);
+            glDeleteTextures(2, textures);
+            framebuffers[0] = framebuffers[1] = 0;
+        }
+    }
+
+private:
+    // Texel rectangle of the map, x1 and y1 exclusive
+    struct Rect {
+        int x0, y0, x1, y1;
+    };
+
+    // Static and dynamic map
+    GLuint framebuffers[2] = { 0, 0 };
+    GLuint textures[2] = { 0, 0 };
+    glm::vec3 cachedLight = glm::vec3(0.0f);
+    unsigned long cachedVersion = 0;
+    Rect previous = { 0, 0, SIZE, SIZE };
+    GLint savedDraw = 0, savedRead = 0;
+    GLint savedViewport[4] = { 0, 0, 0, 0 };
+    long frames = 0, staticDraws = 0, dynamicDraws = 0, copiedTexels = 0;
+
+    void create() {
+        glGenFramebuffers(2, framebuffers);
+        glGenTextures(2, textures);
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SIZE, SIZE, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            // Hardware compared and filtered, everything outside the map is lit
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[i], 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "ERROR::SHADOW_MAP::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Binds one of the maps for drawing, remembering the framebuffer and viewport to go back to
+    void begin(int map) {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedDraw);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &savedRead);
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[map]);
+        glViewport(0, 0, SIZE, SIZE);
+        // Slope scaled depth offset keeps lit surfaces from shadowing themselves
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+    }
+
+    // Looks from the light at the middle of the scene with a square frustum just wide enough for all of it
+    void fit(const glm::vec3& lightPos, const AABB& scene) {
+        glm::vec3 target = scene.center();
+        glm::vec3 forward = glm::normalize(target - lightPos);
+        glm::vec3 up = std::fabs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, -1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(lightPos, target, up);
+
+        float widest = 0.0f, nearest = FLT_MAX, farthest = 0.0f;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? scene.max.x : scene.min.x, (corner & 2) ? scene.max.y : scene.min.y,
+                            (corner & 4) ? scene.max.z : scene.min.z);
+            glm::vec3 local = glm::vec3(view * glm::vec4(point, 1.0f));
+            float depth = -local.z;
+            nearest = std::min(nearest, depth);
+            farthest = std::max(farthest, depth);
+            // Angle off the light's axis, a corner beside or behind the light needs the widest frustum allowed
+            widest = std::max(widest, std::atan2(std::max(std::fabs(local.x), std::fabs(local.y)), depth));
+        }
+        float fovy = std::min(2.0f * widest * 1.02f, glm::radians(160.0f));
+        float zNear = std::max(nearest * 0.9f, 0.05f);
+        float zFar = std::max(farthest * 1.01f, zNear + 0.1f);
+        lightSpace = glm::perspective(fovy, 1.0f, zNear, zFar) * view;
+    }
+
+    // Texels of the map the box covers, the whole map if part of it is behind the light
+    Rect project(const AABB& box) const {
+        glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                            (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = lightSpace * glm::vec4(point, 1.0f);
+            if (clip.w <= 0.0f) {
+                return Rect{ 0, 0, SIZE, SIZE };
+            }
+            glm::vec2 texel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * (float)SIZE;
+            low = glm::min(low, texel);
+            high = glm::max(high, texel);
+        }
+        // One texel of margin for the filtered lookups
+        Rect rect;
+        rect.x0 = std::max(0, std::min(SIZE, (int)std::floor(low.x) - 1));
+        rect.y0 = std::max(0, std::min(SIZE, (int)std::floor(low.y) - 1));
+        rect.x1 = std::max(rect.x0, std::min(SIZE, (int)std::ceil(high.x) + 1));
+        rect.y1 = std::max(rect.y0, std::min(SIZE, (int)std::ceil(high.y) + 1));
+        return rect;
+    }
+
+    static Rect merge(const Rect& a, const Rect& b) {
+        if (a.x0 >= a.x1 || a.y0 >= a.y1) {
+            return b;
+        }
+        if (b.x0 >= b.x1 || b.y0 >= b.y1) {
+            return a;
+        }
+        return Rect{ std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+    }
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*Static batch class*/
+
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "AABB.h"
+#include "GeometryRegistry.h"
+#include "RenderQueue.h"
+
+// One material of a baked group: every opaque part with the same texture and color, already in world space
+struct BakedMesh {
+    GeometryHandle geometry = INVALID_GEOMETRY;
+    // Where the mesh lives in the registry's shared buffers
+    GLuint VAO = 0;
+    GLsizei indexCount = 0;
+    GLuint firstIndex = 0;
+    GLint baseVertex = 0;
+    GLuint texture = 0;                 // 0 for untextured parts
+    glm::vec4 color = glm::vec4(1.0f);
+    bool brighter = false;
+    AABB worldBounds;
+
+    // World space bounding box for culling
+    AABB bounds() const {
+        return worldBounds;
+    }
+
+    // Describe how to draw the mesh for the render queue, the vertices are already in world space
+    DrawItem drawItem(const Shader& shader) const {
+        DrawItem item;
+        item.program = shader.Program;
+        item.VAO = VAO;
+        item.count = indexCount;
+        item.firstIndex = firstIndex;
+        item.baseVertex = baseVertex;
+        item.texture = texture;
+        item.color = color;
+        item.brighter = brighter;
+        return item;
+    }
+};
+
+// Bakes groups of objects that never move into a few world space meshes at load time. The opaque parts of a
+// group are transformed once and merged into one mesh per texture and color, which replaces their individual
+// draws. The original objects stay in their groups for picking and debugging, and transparent parts keep
+// their own draws so they can still be depth sorted. Objects in a baked group must not move afterwards.
+class StaticBatch {
+public:
+    // Every baked mesh of every group, drawn like any other group of objects
+    std::vector<BakedMesh> meshes;
+
+    // Merges the opaque objects into the registry's shared buffers. Parts whose textures share the atlas
+    // share a mesh, their texture coordinates are moved into their regions of it.
+    // T needs geometry, color, textureID, atlasID, uvRect and transform like Cube and wiiGame.
+    template <typename T>
+    void bake(const std::string& name, const std::vector<T>& objects, bool brighter, GeometryRegistry& registry) {
+        struct Material {
+            GLuint texture;
+            glm::vec4 color;
+            std::vector<GLfloat> vertices;
+            std::vector<uint32_t> indices;
+            AABB bounds;
+        };
+        std::vector<Material> materials;
+        Stats stats;
+        stats.name = name;
+
+        for (const auto& object : objects) {
+            if (object.color.w < 1.0f) {
+                stats.transparent++;
+                continue;
+            }
+            GLuint texture = object.atlasID != 0 ? object.atlasID : object.textureID == (GLuint)-1 ? 0 : object.textureID;
+            glm::vec4 uvRect = object.atlasID != 0 ? object.uvRect : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+            size_t index = 0;
+            while (index < materials.size() && !(materials[index].texture == texture && materials[index].color == object.color)) {
+                index++;
+            }
+            if (index == materials.size()) {
+                materials.push_back(Material{ texture, object.color, {}, {}, AABB() });
+            }
+            Material& material = materials[index];
+
+            // Copy the shape out of the registry with the object's transform applied
+            const Geometry& shape = registry.get(object.geometry);
+            const GLfloat* vertices = registry.vertexData(object.geometry);
+            const uint32_t* indices = registry.indexData(object.geometry);
+            const glm::mat4& world = object.transform.world();
+            const glm::mat3& normal = object.transform.normal();
+            uint32_t base = (uint32_t)(material.vertices.size() / 8);
+            for (GLsizei i = 0; i < shape.vertexCount; i++) {
+                const GLfloat* vertex = vertices + i * 8;
+                glm::vec3 position = glm::vec3(world * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+                glm::vec3 direction = glm::normalize(normal * glm::vec3(vertex[3], vertex[4], vertex[5]));
+                // The shaders flip v before applying the region, so flip it around the region here
+                GLfloat s = uvRect.x + vertex[6] * uvRect.z;
+                GLfloat t = 1.0f - (uvRect.y + (1.0f - vertex[7]) * uvRect.w);
+                GLfloat baked[8] = { position.x, position.y, position.z, direction.x, direction.y, direction.z, s, t };
+                material.vertices.insert(material.vertices.end(), baked, baked + 8);
+                material.bounds.add(position);
+            }
+            for (GLsizei i = 0; i < shape.indexCount; i++) {
+                material.indices.push_back(base + indices[i]);
+            }
+            stats.parts++;
+        }
+
+        for (size_t index = 0; index < materials.size(); index++) {
+            const Material& material = materials[index];
+            BakedMesh mesh;
+            mesh.geometry = registry.acquireIndexed("baked:" + name + ":" + std::to_string(index), material.vertices.data(),
+                                                    material.vertices.size() / 8, material.indices.data(), material.indices.size());
+            const Geometry& shape = registry.get(mesh.geometry);
+            mesh.VAO = registry.VAO;
+            mesh.indexCount = shape.indexCount;
+            mesh.firstIndex = shape.firstIndex;
+            mesh.baseVertex = shape.baseVertex;
+            mesh.texture = material.texture;
+            mesh.color = material.color;
+            mesh.brighter = brighter;
+            mesh.worldBounds = material.bounds;
+            meshes.push_back(mesh);
+            stats.bytes += shape.bytes;
+        }
+        stats.meshes = materials.size();
+        groups.push_back(stats);
+    }
+
+    // Whether the named group was baked, its opaque objects must then not be drawn on their own
+    bool baked(const std::string& name) const {
+        for (const auto& group : groups) {
+            if (group.name == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Prints what baking saved and cost for every group, to decide which groups are worth baking
+    void report() const {
+        for (const auto& group : groups) {
+            std::cout << "Static batch: " << group.name << " baked " << group.parts << " parts into " << group.meshes
+                      << " draws (" << (long)group.parts - (long)group.meshes << " fewer draw calls), "
+                      << group.bytes << " more bytes of vertex memory";
+            if (group.transparent > 0) {
+                std::cout << ", " << group.transparent << " transparent parts left unbaked";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+private:
+    struct Stats {
+        std::string name;
+        size_t parts = 0, meshes = 0, transparent = 0;
+        GLsizeiptr bytes = 0;
+    };
+    std::vector<Stats> groups;
+};
+
+#endif
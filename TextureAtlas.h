@@ -0,0 +1,224 @@
+/*Texture atlas class*/
+
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <future>
+#include <algorithm>
+#include <iostream>
+#include <climits>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "TextureDiskCache.h"
+
+// Packs small images into one texture at load time so the objects using them share a texture binding.
+// Images are placed with a skyline packer. Every image is surrounded by a gutter of its own edge texels,
+// and the places and sizes snap to the gutter width, so the first MIP_LEVELS mip levels never blend
+// neighbouring images together.
+class TextureAtlas {
+public:
+    static const int GUTTER = 8;
+    // Mip levels past the base level that stay inside each image's gutter, log2 of GUTTER
+    static const int MIP_LEVELS = 3;
+
+    GLuint texture = 0;
+
+    // Loads the images through the disk cache and packs them, scaling each one so its longest side is at
+    // most maxSize texels. The atlas is width texels wide and as tall as the images need.
+    void build(const std::vector<std::string>& paths, TextureDiskCache& disk, int maxSize = 256, int width = 2048) {
+        destroy();
+        if (paths.empty()) {
+            return;
+        }
+
+        // Decode the images in parallel, most come straight out of the disk cache
+        std::vector<std::future<TexelImage>> loads;
+        for (const auto& path : paths) {
+            std::cout << "Loading atlas image: " << path << std::endl;
+            loads.push_back(std::async(std::launch::async, [&disk, path] { return disk.load(path); }));
+        }
+        std::vector<Image> images;
+        for (size_t i = 0; i < paths.size(); i++) {
+            TexelImage texels = loads[i].get();
+            if (texels.format != GL_RGBA8) {
+                std::cerr << "Failed to load texture: " << paths[i] << std::endl;
+                continue;
+            }
+            const TexelLevel& base = texels.levels[0];
+            Image image;
+            image.path = paths[i];
+            float scale = std::min(1.0f, (float)maxSize / std::max(base.width, base.height));
+            image.width = snap(std::max(1, (int)(base.width * scale)));
+            image.height = snap(std::max(1, (int)(base.height * scale)));
+            image.pixels.resize((size_t)image.width * image.height * 4);
+            TextureDiskCache::resample(texels.bytes.get() + base.offset, base.width, base.height,
+                                       image.pixels.data(), image.width, image.height);
+            images.push_back(image);
+        }
+
+        // Tallest images first keeps the skyline flat
+        std::sort(images.begin(), images.end(), [](const Image& a, const Image& b) {
+            return a.height != b.height ? a.height > b.height : a.width > b.width;
+        });
+        skyline.assign(1, Segment{ 0, 0, width });
+        int height = 0;
+        for (auto& image : images) {
+            if (!place(image.width + 2 * GUTTER, image.height + 2 * GUTTER, width, image.x, image.y)) {
+                std::cerr << "ERROR::ATLAS::TOO_WIDE " << image.path << std::endl;
+                continue;
+            }
+            image.x += GUTTER;
+            image.y += GUTTER;
+            height = std::max(height, image.y + image.height + GUTTER);
+        }
+
+        // Copy every image into place and extrude its edges into the gutter
+        std::vector<unsigned char> pixels((size_t)width * height * 4, 0);
+        for (const auto& image : images) {
+            if (image.x < 0) {
+                continue;
+            }
+            for (int y = -GUTTER; y < image.height + GUTTER; y++) {
+                int sourceY = std::min(std::max(y, 0), image.height - 1);
+                for (int x = -GUTTER; x < image.width + GUTTER; x++) {
+                    int sourceX = std::min(std::max(x, 0), image.width - 1);
+                    const unsigned char* from = &image.pixels[((size_t)sourceY * image.width + sourceX) * 4];
+                    unsigned char* to = &pixels[((size_t)(image.y + y) * width + image.x + x) * 4];
+                    std::copy(from, from + 4, to);
+                }
+            }
+            regions[image.path] = glm::vec4((float)image.x / width, (float)image.y / height,
+                                            (float)image.width / width, (float)image.height / height);
+            usedTexels += (long)image.width * image.height;
+        }
+        atlasWidth = width;
+        atlasHeight = height;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MIP_LEVELS);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Returns the atlas and sets region to where the image at path is in it (u, v offset and u, v scale
+    // of the shaders' texture coordinates), or returns 0 if the image was not packed
+    GLuint find(const std::string& path, glm::vec4& region) const {
+        auto found = regions.find(path);
+        if (found == regions.end()) {
+            return 0;
+        }
+        region = found->second;
+        return texture;
+    }
+
+    // Prints how full the atlas is
+    void report() const {
+        if (texture != 0) {
+            std::cout << "Texture atlas: " << regions.size() << " images in " << atlasWidth << " x " << atlasHeight
+                      << " texels, " << 100.0 * usedTexels / ((double)atlasWidth * atlasHeight) << "% used" << std::endl;
+        }
+    }
+
+    void destroy() {
+        if (texture != 0) {
+            glDeleteTextures(1, &texture);
+            texture = 0;
+        }
+        regions.clear();
+        usedTexels = 0;
+    }
+
+private:
+    struct Image {
+        std::string path;
+        int x = -1, y = -1, width = 0, height = 0;
+        std::vector<unsigned char> pixels;
+    };
+
+    // A horizontal run of the skyline: the atlas is filled up to y between x and x + width
+    struct Segment {
+        int x, y, width;
+    };
+
+    std::vector<Segment> skyline;
+    std::map<std::string, glm::vec4> regions;
+    int atlasWidth = 0, atlasHeight = 0;
+    long usedTexels = 0;
+
+    // Rounds a size up to a whole number of gutters
+    static int snap(int size) {
+        return (size + GUTTER - 1) / GUTTER * GUTTER;
+    }
+
+    // Finds the lowest spot a width x height rectangle fits on the skyline, wasting the least space under it on ties,
+    // and raises the skyline over it
+    bool place(int width, int height, int atlasWidth, int& x, int& y) {
+        size_t best = SIZE_MAX;
+        int bestY = INT_MAX, bestWaste = INT_MAX;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            if (skyline[i].x + width > atlasWidth) {
+                break;
+            }
+            // The rectangle rests on the highest segment it spans
+            int top = 0, waste = 0;
+            for (size_t j = i; j < skyline.size() && skyline[j].x < skyline[i].x + width; j++) {
+                top = std::max(top, skyline[j].y);
+            }
+            for (size_t j = i; j < skyline.size() && skyline[j].x < skyline[i].x + width; j++) {
+                int covered = std::min(skyline[j].x + skyline[j].width, skyline[i].x + width) - skyline[j].x;
+                waste += (top - skyline[j].y) * covered;
+            }
+            if (top < bestY || (top == bestY && waste < bestWaste)) {
+                best = i;
+                bestY = top;
+                bestWaste = waste;
+            }
+        }
+        if (best == SIZE_MAX) {
+            return false;
+        }
+        x = skyline[best].x;
+        y = bestY;
+
+        // Replace the segments under the rectangle with one segment on top of it
+        Segment raised = { x, y + height, width };
+        size_t end = best;
+        while (end < skyline.size() && skyline[end].x + skyline[end].width <= x + width) {
+            end++;
+        }
+        if (end < skyline.size() && skyline[end].x < x + width) {
+            // Keep the part of a partly covered segment that sticks out on the right
+            int cut = x + width - skyline[end].x;
+            skyline[end].x += cut;
+            skyline[end].width -= cut;
+        }
+        skyline.erase(skyline.begin() + best, skyline.begin() + end);
+        skyline.insert(skyline.begin() + best, raised);
+
+        // Merge neighbours at the same height
+        for (size_t i = 0; i + 1 < skyline.size(); ) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                i++;
+            }
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,419 @@
+/*Texture cache class*/
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <tuple>
+#include <deque>
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <condition_variable>
+
+#include <GL/glew.h>
+
+#include "TextureDiskCache.h"
+
+// Sampler state a texture is created with, part of the cache key
+struct SamplerSettings {
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+    GLint minFilter = GL_LINEAR;
+    GLint magFilter = GL_LINEAR;
+    bool mipmaps = true;
+
+    bool operator<(const SamplerSettings& other) const {
+        return std::tie(wrapS, wrapT, minFilter, magFilter, mipmaps) <
+               std::tie(other.wrapS, other.wrapT, other.minFilter, other.magFilter, other.mipmaps);
+    }
+};
+
+// Decodes and uploads every image once and hands out reference counted texture IDs.
+// Images are decoded by a pool of loader threads while the caller keeps building the scene,
+// the GL thread then streams the pixels to the textures through pixel buffer objects.
+// Decoded images and their mip chains are kept on disk, so later runs skip decoding entirely.
+class TextureCache {
+public:
+    TextureDiskCache disk;
+
+    ~TextureCache() {
+        stopWorkers();
+    }
+
+    // Returns the texture for the path and sampler settings, starting to load it on first use.
+    // The texture name is valid right away, its image arrives with pump() or finishLoading().
+    GLuint acquire(const std::string& path, const SamplerSettings& sampler = SamplerSettings()) {
+        requests++;
+        Key key(path, sampler);
+        auto found = entries.find(key);
+        if (found != entries.end()) {
+            found->second.references++;
+            found->second.requests++;
+            requestedBytes += found->second.bytes;
+            return found->second.texture;
+        }
+
+        std::cout << "Loading texture: " << path << std::endl;
+        Entry entry;
+        entry.texture = create(sampler);
+        entry.references = 1;
+        entry.requests = 1;
+        entry.bytes = 0;
+        entry.mipmaps = sampler.mipmaps;
+        entries[key] = entry;
+        decode(entry.texture, path);
+        return entry.texture;
+    }
+
+    // Uploads the images that finished decoding, without waiting for the others
+    void pump() {
+        std::deque<DecodedImage> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(decoded);
+        }
+        for (auto& image : ready) {
+            upload(image);
+        }
+    }
+
+    // Uploads every outstanding image, each one as soon as its decode finishes
+    void finishLoading() {
+        while (pending > 0) {
+            std::deque<DecodedImage> ready;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                decodedReady.wait(lock, [this] { return !decoded.empty(); });
+                ready.swap(decoded);
+            }
+            for (auto& image : ready) {
+                upload(image);
+            }
+        }
+    }
+
+    // Returns a GL_TEXTURE_2D_ARRAY with one layer per path, every image resampled to layerSize x layerSize
+    GLuint acquireArray(const std::vector<std::string>& paths, int layerSize = 1024) {
+        requests++;
+        std::string joined = "array:" + std::to_string(layerSize);
+        for (const auto& path : paths) {
+            joined += "|" + path;
+        }
+        Key key(joined, SamplerSettings());
+        auto found = entries.find(key);
+        if (found != entries.end()) {
+            found->second.references++;
+            found->second.requests++;
+            requestedBytes += found->second.bytes;
+            return found->second.texture;
+        }
+
+        Entry entry;
+        entry.texture = loadArray(paths, layerSize, entry.bytes);
+        entry.references = 1;
+        entry.requests = 1;
+        entry.mipmaps = true;
+        requestedBytes += entry.bytes;
+        residentBytes += entry.bytes;
+        entries[key] = entry;
+        return entry.texture;
+    }
+
+    // Returns the path a cached 2D texture was loaded from, or an empty string
+    std::string pathOf(GLuint texture) const {
+        for (const auto& entry : entries) {
+            if (entry.second.texture == texture) {
+                return entry.first.first;
+            }
+        }
+        return std::string();
+    }
+
+    // Drops one reference to the texture and deletes it once nobody uses it
+    void release(GLuint texture) {
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.texture != texture) {
+                continue;
+            }
+            if (--it->second.references == 0) {
+                glDeleteTextures(1, &it->second.texture);
+                residentBytes -= it->second.bytes;
+                entries.erase(it);
+            }
+            return;
+        }
+    }
+
+    // Prints how many decodes and how much texture memory the cache saves
+    void report() const {
+        std::cout << "Textures: " << entries.size() << " images decoded for " << requests << " requests, "
+                  << residentBytes << " bytes resident instead of " << requestedBytes << std::endl;
+        std::cout << "Texture disk cache: " << disk.hits << " images read, " << disk.misses << " decoded" << std::endl;
+    }
+
+    // Deletes every cached texture regardless of its references
+    void destroy() {
+        stopWorkers();
+        for (auto& entry : entries) {
+            glDeleteTextures(1, &entry.second.texture);
+        }
+        entries.clear();
+        residentBytes = 0;
+        if (uploadBuffers[0] != 0) {
+            glDeleteBuffers(2, uploadBuffers);
+            uploadBuffers[0] = uploadBuffers[1] = 0;
+        }
+    }
+
+private:
+    typedef std::pair<std::string, SamplerSettings> Key;
+
+    struct Entry {
+        GLuint texture;
+        int references;
+        int requests;
+        bool mipmaps;
+        // Estimated GPU memory including the mip chain, 0 until the image is uploaded
+        long bytes;
+    };
+
+    // An image a loader thread finished loading
+    struct DecodedImage {
+        GLuint texture;
+        std::string path;
+        TexelImage texels;
+    };
+
+    // Create the texture object and its sampler state, the image is uploaded later
+    GLuint create(const SamplerSettings& sampler) const {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
+        // Set our texture parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+        // Set texture filtering
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+        glBindTexture(GL_TEXTURE_2D, 0);  // Unbind the texture
+        return texture;
+    }
+
+    // Hand the image to the loader threads, starting them on first use
+    void decode(GLuint texture, const std::string& path) {
+        if (workers.empty()) {
+            unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned int i = 0; i < count; i++) {
+                workers.emplace_back(&TextureCache::work, this);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::make_pair(texture, path));
+        }
+        pending++;
+        jobReady.notify_one();
+    }
+
+    // Loader thread: decode queued images until the cache stops
+    void work() {
+        while (true) {
+            std::pair<GLuint, std::string> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            DecodedImage image;
+            image.texture = job.first;
+            image.path = job.second;
+            image.texels = disk.load(job.second);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_back(image);
+            }
+            decodedReady.notify_one();
+        }
+    }
+
+    void stopWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        decoded.clear();
+        jobs.clear();
+        pending = 0;
+        stopping = false;
+    }
+
+    // Streams a loaded mip chain into its texture through the pixel buffers
+    void upload(DecodedImage& image) {
+        pending--;
+        Entry* entry = NULL;
+        for (auto& cached : entries) {
+            if (cached.second.texture == image.texture) {
+                entry = &cached.second;
+            }
+        }
+        const TexelImage& texels = image.texels;
+        if (texels.format == 0) {
+            std::cerr << "Failed to load texture: " << image.path << std::endl;
+            return;
+        }
+        // The texture may have been released while it was loading
+        if (!entry) {
+            return;
+        }
+
+        // Let the driver compress images that are not compressed on disk yet
+        bool compressing = !texels.compressedName.empty() && GLEW_EXT_texture_compression_s3tc;
+        GLenum internalFormat = compressing ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+        size_t levelCount = entry->mipmaps ? texels.levels.size() : 1;
+
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+        entry->bytes = 0;
+        for (size_t i = 0; i < levelCount; i++) {
+            const TexelLevel& level = texels.levels[i];
+            uploadPixels(texels.bytes.get() + level.offset, level.size);
+            if (texels.format == GL_RGBA8) {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+            } else {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, texels.format, level.width, level.height, 0, (GLsizei)level.size, (GLvoid*)0);
+            }
+            entry->bytes += (long)level.size;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        // Read the compressed chain back once so later runs can upload it directly
+        if (compressing && levelCount == texels.levels.size()) {
+            TexelImage compressed;
+            compressed.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            std::vector<unsigned char> data;
+            entry->bytes = 0;
+            for (size_t i = 0; i < levelCount; i++) {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint)i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                TexelLevel level = { texels.levels[i].width, texels.levels[i].height, data.size(), (size_t)size };
+                data.resize(data.size() + size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, (GLint)i, data.data() + level.offset);
+                compressed.levels.push_back(level);
+                entry->bytes += size;
+            }
+            unsigned char* bytes = new unsigned char[data.size()];
+            std::memcpy(bytes, data.data(), data.size());
+            compressed.bytes = std::shared_ptr<const unsigned char>(bytes, std::default_delete<const unsigned char[]>());
+            disk.store(texels.compressedName, TextureDiskCache::hashOf(texels.compressedName), compressed);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        requestedBytes += entry->bytes * entry->requests;
+        residentBytes += entry->bytes;
+    }
+
+    // Fills the next of two alternating pixel buffers and leaves it bound as the unpack buffer,
+    // so the driver can copy one to the GPU while the other is being written
+    void uploadPixels(const unsigned char* pixels, size_t size) {
+        if (uploadBuffers[0] == 0) {
+            glGenBuffers(2, uploadBuffers);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffers[nextUploadBuffer]);
+        nextUploadBuffer = 1 - nextUploadBuffer;
+        // Orphan the old storage so writing never waits for the previous upload from this buffer
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped) {
+            std::memcpy(mapped, pixels, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        } else {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, pixels);
+        }
+    }
+
+    // Load every image into its own layer of a texture array, decoding the layers in parallel
+    GLuint loadArray(const std::vector<std::string>& paths, int layerSize, long& bytes) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        std::vector<std::future<TexelImage>> layers;
+        for (const auto& path : paths) {
+            std::cout << "Loading texture layer: " << path << std::endl;
+            layers.push_back(std::async(std::launch::async, [this, path, layerSize] {
+                return disk.load(path, layerSize);
+            }));
+        }
+
+        // Allocate every level of every layer, then fill them one by one
+        std::vector<int> sizes;
+        for (int size = layerSize; ; size = std::max(1, size / 2)) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)sizes.size(), GL_RGBA8, size, size, (GLsizei)paths.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            sizes.push_back(size);
+            if (size == 1) {
+                break;
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)sizes.size() - 1);
+
+        // Upload the layers in order, each one as soon as it is ready
+        bytes = 0;
+        for (size_t i = 0; i < paths.size(); i++) {
+            TexelImage layer = layers[i].get();
+            if (layer.format != GL_RGBA8 || layer.levels.size() != sizes.size()) {
+                std::cerr << "Failed to load texture: " << paths[i] << std::endl;
+                continue;
+            }
+            for (size_t l = 0; l < layer.levels.size(); l++) {
+                const TexelLevel& level = layer.levels[l];
+                uploadPixels(layer.bytes.get() + level.offset, level.size);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, 0, 0, (GLint)i, level.width, level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+                bytes += (long)level.size;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    std::map<Key, Entry> entries;
+
+    // Loader threads and their queues, guarded by mutex
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobReady, decodedReady;
+    std::deque<std::pair<GLuint, std::string>> jobs;
+    std::deque<DecodedImage> decoded;
+    bool stopping = false;
+    // Images requested but not uploaded yet, only touched by the GL thread
+    int pending = 0;
+
+    GLuint uploadBuffers[2] = { 0, 0 };
+    int nextUploadBuffer = 0;
+
+    long requests = 0;
+    long residentBytes = 0;
+    // Memory the same requests would use with one texture per object
+    long requestedBytes = 0;
+};
+
+#endif
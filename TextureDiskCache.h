@@ -0,0 +1,267 @@
+/*Texture disk cache class*/
+
+#ifndef TEXTURE_DISK_CACHE_H
+#define TEXTURE_DISK_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+#include <SOIL/SOIL.h>
+
+// One mip level of a TexelImage
+struct TexelLevel {
+    int width, height;
+    size_t offset, size;    // Bytes into TexelImage::bytes
+};
+
+// The full mip chain of one image, either mapped from the disk cache or freshly decoded
+struct TexelImage {
+    GLenum format = 0;      // GL_RGBA8 or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0 if the image failed to load
+    std::vector<TexelLevel> levels;
+    std::shared_ptr<const unsigned char> bytes;
+    bool fromDisk = false;
+    // Where a compressed copy of the image belongs, empty if the image already is compressed
+    std::string compressedName;
+};
+
+// Stores decoded images with their mip chains on disk, named by a hash of the source file
+// so an edited image misses the cache and is decoded again
+class TextureDiskCache {
+public:
+    // Directory the cache lives in, an empty string turns the cache off
+    std::string directory = ".texture_cache";
+    // Keep DXT5 compressed images, the GL thread compresses them on the first load
+    bool compress = false;
+
+    // Images served from disk and images decoded, may be updated from several threads
+    std::atomic<long> hits{0}, misses{0};
+
+    // Returns the image at path with its mip chain, resampled to size x size if size is not 0.
+    // Safe to call from several threads at once.
+    TexelImage load(const std::string& path, int size = 0) {
+        TexelImage image;
+        std::ifstream file(path, std::ios::binary);
+        std::vector<unsigned char> source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (source.empty()) {
+            return image;
+        }
+        uint64_t hash = fnv1a(source.data(), source.size());
+        std::string name = cacheName(hash, size);
+
+        if (!directory.empty()) {
+            if (compress && map(name + ".dxt5", hash, image)) {
+                hits++;
+                return image;
+            }
+            if (map(name + ".rgba", hash, image)) {
+                hits++;
+                image.compressedName = compress ? name + ".dxt5" : std::string();
+                return image;
+            }
+        }
+
+        misses++;
+        int width, height;
+        unsigned char* pixels = SOIL_load_image_from_memory(source.data(), (int)source.size(), &width, &height, 0, SOIL_LOAD_RGBA);
+        if (!pixels) {
+            return image;
+        }
+        std::vector<unsigned char> base;
+        if (size > 0) {
+            base.resize((size_t)size * size * 4);
+            resample(pixels, width, height, base.data(), size, size);
+            width = height = size;
+        } else {
+            base.assign(pixels, pixels + (size_t)width * height * 4);
+        }
+        SOIL_free_image_data(pixels);
+
+        buildMipChain(base, width, height, image);
+        if (!directory.empty()) {
+            store(name + ".rgba", hash, image);
+            image.compressedName = compress ? name + ".dxt5" : std::string();
+        }
+        return image;
+    }
+
+    // Writes an image under name, replacing any earlier file atomically
+    bool store(const std::string& name, uint64_t hash, const TexelImage& image) {
+        mkdir(directory.c_str(), 0755);
+        std::string path = directory + "/" + name;
+        std::string temporary = path + ".tmp" + std::to_string((uintptr_t)&image);
+
+        FileHeader header;
+        std::memcpy(header.magic, "TXC1", 4);
+        header.version = VERSION;
+        header.sourceHash = hash;
+        header.format = image.format;
+        header.levelCount = (uint32_t)image.levels.size();
+
+        std::vector<FileLevel> levels(image.levels.size());
+        uint64_t offset = sizeof(FileHeader) + levels.size() * sizeof(FileLevel);
+        for (size_t i = 0; i < levels.size(); i++) {
+            levels[i].width = image.levels[i].width;
+            levels[i].height = image.levels[i].height;
+            levels[i].offset = offset;
+            levels[i].size = image.levels[i].size;
+            offset += levels[i].size;
+        }
+
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)levels.data(), levels.size() * sizeof(FileLevel));
+        for (const auto& level : image.levels) {
+            file.write((const char*)image.bytes.get() + level.offset, level.size);
+        }
+        file.close();
+        if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the source hash back out of a cache name made by load()
+    static uint64_t hashOf(const std::string& name) {
+        return std::strtoull(name.substr(0, 16).c_str(), NULL, 16);
+    }
+
+    // Box filters an RGBA image to a new size
+    static void resample(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight) {
+        for (int y = 0; y < dstHeight; y++) {
+            int y0 = y * srcHeight / dstHeight;
+            int y1 = std::max(y0 + 1, (y + 1) * srcHeight / dstHeight);
+            for (int x = 0; x < dstWidth; x++) {
+                int x0 = x * srcWidth / dstWidth;
+                int x1 = std::max(x0 + 1, (x + 1) * srcWidth / dstWidth);
+                unsigned int sum[4] = { 0, 0, 0, 0 };
+                for (int sy = y0; sy < y1; sy++) {
+                    const unsigned char* row = src + ((size_t)sy * srcWidth + x0) * 4;
+                    for (int sx = x0; sx < x1; sx++, row += 4) {
+                        sum[0] += row[0];
+                        sum[1] += row[1];
+                        sum[2] += row[2];
+                        sum[3] += row[3];
+                    }
+                }
+                unsigned int count = (unsigned int)((y1 - y0) * (x1 - x0));
+                unsigned char* out = dst + ((size_t)y * dstWidth + x) * 4;
+                for (int c = 0; c < 4; c++) {
+                    out[c] = (unsigned char)(sum[c] / count);
+                }
+            }
+        }
+    }
+
+private:
+    static const uint32_t VERSION = 1;
+
+    // Start of a cache file, followed by levelCount FileLevels and then the texels
+    struct FileHeader {
+        char magic[4];          // "TXC1"
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t format;
+        uint32_t levelCount;
+    };
+
+    struct FileLevel {
+        uint32_t width, height;
+        uint64_t offset, size;  // Bytes from the start of the file
+    };
+
+    static uint64_t fnv1a(const unsigned char* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string cacheName(uint64_t hash, int size) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        return size > 0 ? std::string(name) + "_" + std::to_string(size) : std::string(name);
+    }
+
+    // Maps a cache file into image, fails if it is missing, damaged or made from another source
+    bool map(const std::string& name, uint64_t hash, TexelImage& image) const {
+        std::string path = directory + "/" + name;
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        size_t size = 0;
+        if (fstat(file, &info) == 0 && info.st_size >= (off_t)sizeof(FileHeader)) {
+            size = (size_t)info.st_size;
+            mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+        }
+        close(file);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        std::shared_ptr<const unsigned char> bytes((const unsigned char*)mapped, [size](const unsigned char* data) {
+            munmap((void*)data, size);
+        });
+
+        const FileHeader* header = (const FileHeader*)mapped;
+        if (std::memcmp(header->magic, "TXC1", 4) != 0 || header->version != VERSION || header->sourceHash != hash ||
+            sizeof(FileHeader) + (size_t)header->levelCount * sizeof(FileLevel) > size) {
+            return false;
+        }
+        const FileLevel* levels = (const FileLevel*)(bytes.get() + sizeof(FileHeader));
+        image.levels.clear();
+        for (uint32_t i = 0; i < header->levelCount; i++) {
+            if (levels[i].offset + levels[i].size > size) {
+                return false;
+            }
+            TexelLevel level = { (int)levels[i].width, (int)levels[i].height, (size_t)levels[i].offset, (size_t)levels[i].size };
+            image.levels.push_back(level);
+        }
+        image.format = header->format;
+        image.bytes = bytes;
+        image.fromDisk = true;
+        return true;
+    }
+
+    // Fills image with the base level and every smaller level down to 1x1
+    static void buildMipChain(const std::vector<unsigned char>& base, int width, int height, TexelImage& image) {
+        size_t total = 0;
+        for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+            TexelLevel level = { w, h, total, (size_t)w * h * 4 };
+            image.levels.push_back(level);
+            total += level.size;
+            if (w == 1 && h == 1) {
+                break;
+            }
+        }
+        unsigned char* texels = new unsigned char[total];
+        std::memcpy(texels, base.data(), base.size());
+        for (size_t i = 1; i < image.levels.size(); i++) {
+            const TexelLevel& from = image.levels[i - 1];
+            const TexelLevel& to = image.levels[i];
+            resample(texels + from.offset, from.width, from.height, texels + to.offset, to.width, to.height);
+        }
+        image.format = GL_RGBA8;
+        image.bytes = std::shared_ptr<const unsigned char>(texels, std::default_delete<const unsigned char[]>());
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*Transform class*/
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+// GLM Includes
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Position, angles (degrees, applied x then y then z) and scale of an object.
+// The world and normal matrices are cached and only rebuilt after one of them changes.
+class Transform {
+public:
+    Transform(glm::vec3 position = glm::vec3(0.0f), glm::vec3 angle = glm::vec3(0.0f), glm::vec3 scale = glm::vec3(1.0f))
+        : position(position), angle(angle), scale(scale) {
+    }
+
+    const glm::vec3& getPosition() const { return position; }
+    const glm::vec3& getAngle() const { return angle; }
+    const glm::vec3& getScale() const { return scale; }
+
+    void setPosition(const glm::vec3& value) { position = value; changed(); }
+    void setAngle(const glm::vec3& value) { angle = value; changed(); }
+    void setScale(const glm::vec3& value) { scale = value; changed(); }
+
+    // Returns the model matrix
+    const glm::mat4& world() const {
+        update();
+        return worldMatrix;
+    }
+
+    // Returns the inverse transpose of the model matrix for transforming normals
+    const glm::mat3& normal() const {
+        update();
+        return normalMatrix;
+    }
+
+    // Increases every time the transform changes, lets dependent caches notice a change
+    unsigned long version() const { return revision; }
+
+private:
+    glm::vec3 position;
+    glm::vec3 angle;
+    glm::vec3 scale;
+    unsigned long revision = 0;
+
+    mutable bool dirty = true;
+    mutable glm::mat4 worldMatrix;
+    mutable glm::mat3 normalMatrix;
+
+    void changed() {
+        dirty = true;
+        revision++;
+    }
+
+    // Rebuilds the cached matrices if the transform changed since they were built
+    void update() const {
+        if (!dirty)
+            return;
+        // Create a default model to adjust
+        glm::mat4 model = glm::mat4(1.0f);
+        // Set the position
+        model = glm::translate(model, position);
+        // Apply rotations in a specific order
+        model = glm::rotate(model, glm::radians(angle.x), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around x-axis
+        model = glm::rotate(model, glm::radians(angle.y), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around y-axis
+        model = glm::rotate(model, glm::radians(angle.z), glm::vec3(0.0f, 0.0f, 1.0f)); // Rotate around z-axis
+        // Set the scale
+        model = glm::scale(model, scale);
+        worldMatrix = model;
+        normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        dirty = false;
+    }
+};
+
+#endif